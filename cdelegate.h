@@ -0,0 +1,258 @@
+/****************************************************************************
+**
+** Copyright (c) 2013 Calibri-Software <calibrisoftware@gmail.com>
+**
+** Permission is hereby granted, free of charge, to any person obtaining a copy
+** of this software and associated documentation files (the "Software"), to deal
+** in the Software without restriction, including without limitation the rights
+** to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+** copies of the Software, and to permit persons to whom the Software is
+** furnished to do so, subject to the following conditions:
+**
+** The above copyright notice and this permission notice shall be included in
+** all copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+** IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+** FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+** AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+** LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+** OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+** THE SOFTWARE.
+**
+****************************************************************************/
+
+#ifndef CDELEGATE_H
+#define CDELEGATE_H
+
+//! Std Includes
+#include <cstddef>
+#include <cstring>
+#include <functional>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+//! Project Includes
+#include "cdefines.h"
+
+//! Defines
+#if !defined(C_DELEGATE_STORAGE_SIZE)
+#   define C_DELEGATE_STORAGE_SIZE      (2 * sizeof(void *))
+#endif
+
+template<class T>
+class CDelegate;
+
+//! Fixed-size callable wrapper: the target is stored inline and never on
+//! the heap, trivially copyable targets are copied with memcpy and every
+//! call is a single indirect call. The storage holds two pointers, pass
+//! larger captures through a pointer.
+template<class R, class... Args>
+class CDelegate<R (Args...)>
+{
+public:
+    inline CDelegate()
+        : m_invoker(nullptr)
+        , m_manager(nullptr)
+    {
+    }
+
+    inline CDelegate(std::nullptr_t)
+        : m_invoker(nullptr)
+        , m_manager(nullptr)
+    {
+    }
+
+    template<class F, class = typename std::enable_if<!std::is_same<typename std::decay<F>::type, CDelegate>::value>::type>
+    inline CDelegate(F &&f)
+        : m_invoker(nullptr)
+        , m_manager(nullptr)
+    {
+        assign(std::forward<F>(f));
+    }
+
+    inline CDelegate(const CDelegate &other)
+        : m_invoker(nullptr)
+        , m_manager(nullptr)
+    {
+        copy(other);
+    }
+
+    inline CDelegate(CDelegate &&other)
+        : m_invoker(nullptr)
+        , m_manager(nullptr)
+    {
+        move(other);
+    }
+
+    inline ~CDelegate()
+    {
+        reset();
+    }
+
+    inline CDelegate &operator =(const CDelegate &other)
+    {
+        if (this != &other) {
+            reset();
+            copy(other);
+        }
+
+        return *this;
+    }
+
+    inline CDelegate &operator =(CDelegate &&other)
+    {
+        if (this != &other) {
+            reset();
+            move(other);
+        }
+
+        return *this;
+    }
+
+    inline CDelegate &operator =(std::nullptr_t)
+    {
+        reset();
+
+        return *this;
+    }
+
+    template<class F, class = typename std::enable_if<!std::is_same<typename std::decay<F>::type, CDelegate>::value>::type>
+    inline CDelegate &operator =(F &&f)
+    {
+        reset();
+        assign(std::forward<F>(f));
+
+        return *this;
+    }
+
+    inline R operator ()(Args... args) const
+    {
+        return m_invoker(const_cast<void *>(static_cast<const void *>(&m_storage)), std::forward<Args>(args)...);
+    }
+
+    inline explicit operator bool() const
+    {
+        return m_invoker != nullptr;
+    }
+
+private:
+    enum Operation : c_uint8 {
+        Copy = 1,
+        Move,
+        Destroy
+    };
+
+    typedef R (*Invoker)(void *storage, Args... args);
+    typedef void (*Manager)(const Operation operation, void *dest, void *source);
+
+    template<class F>
+    static inline R invoke(void *storage, Args... args)
+    {
+        return (*static_cast<F *>(storage))(std::forward<Args>(args)...);
+    }
+
+    template<class F>
+    static inline void manage(const Operation operation, void *dest, void *source)
+    {
+        switch (operation) {
+        case Copy:
+            new (dest) F(*static_cast<const F *>(source));
+
+            break;
+
+        case Move:
+            new (dest) F(std::move(*static_cast<F *>(source)));
+            static_cast<F *>(source)->~F();
+
+            break;
+
+        case Destroy:
+            static_cast<F *>(dest)->~F();
+
+            break;
+
+        default:
+            break;
+        }
+    }
+
+    template<class F>
+    static inline const bool isNull(const F &f)
+    {
+        C_UNUSED(f);
+
+        return false;
+    }
+
+    template<class F>
+    static inline const bool isNull(F *f)
+    {
+        return f == nullptr;
+    }
+
+    template<class Signature>
+    static inline const bool isNull(const std::function<Signature> &f)
+    {
+        return !f;
+    }
+
+    template<class F>
+    inline void assign(F &&f)
+    {
+        typedef typename std::decay<F>::type Callable;
+
+        static_assert(sizeof(Callable) <= C_DELEGATE_STORAGE_SIZE, "callable does not fit into CDelegate storage");
+        static_assert(alignof(Callable) <= alignof(void *), "callable is over-aligned for CDelegate storage");
+
+        if (isNull(f))
+            return;
+
+        new (&m_storage) Callable(std::forward<F>(f));
+
+        m_invoker = &CDelegate::invoke<Callable>;
+        m_manager = std::is_trivially_copyable<Callable>::value ? nullptr : &CDelegate::manage<Callable>;
+    }
+
+    inline void copy(const CDelegate &other)
+    {
+        if (other.m_manager)
+            other.m_manager(Copy, &m_storage, const_cast<void *>(static_cast<const void *>(&other.m_storage)));
+        else
+            memcpy(&m_storage, &other.m_storage, C_DELEGATE_STORAGE_SIZE);
+
+        m_invoker = other.m_invoker;
+        m_manager = other.m_manager;
+    }
+
+    inline void move(CDelegate &other)
+    {
+        if (other.m_manager)
+            other.m_manager(Move, &m_storage, &other.m_storage);
+        else
+            memcpy(&m_storage, &other.m_storage, C_DELEGATE_STORAGE_SIZE);
+
+        m_invoker = other.m_invoker;
+        m_manager = other.m_manager;
+
+        other.m_invoker = nullptr;
+        other.m_manager = nullptr;
+    }
+
+    inline void reset()
+    {
+        if (m_manager)
+            m_manager(Destroy, &m_storage, nullptr);
+
+        m_invoker = nullptr;
+        m_manager = nullptr;
+    }
+
+    typename std::aligned_storage<C_DELEGATE_STORAGE_SIZE, alignof(void *)>::type m_storage;
+
+    Invoker m_invoker;
+    Manager m_manager;
+};
+
+#endif // CDELEGATE_H
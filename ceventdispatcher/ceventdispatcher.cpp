@@ -27,22 +27,124 @@
 
 //! Platform Includes
 #if defined(_WIN32)
+#   include <cstdlib>
 #   include <WS2tcpip.h>
 #elif defined(__unix__) || defined(__linux__)
 #   include <cstring>
+#   include <cstddef>
+#   include <netinet/tcp.h>
+#   include <sys/stat.h>
+#   include <sys/un.h>
+#   include <unistd.h>
 #endif
 
+//! Std Includes
+#include <algorithm>
+#include <chrono>
+#include <future>
+
 //! LibEvent Includes
 #include <event2/listener.h>
 #include <event2/bufferevent_ssl.h>
+#include <event2/thread.h>
 
 //! CEventDispatcher Includes
 #include "ceventdispatcher_types.h"
 #include "ceventdispatcher_config.h"
+#include "ceventdispatcher_ratelimit.h"
 
 //! Defines
 #define AF_INET_LENGTH          16
 #define AF_INET6_LENGTH         48
+#define COMMON_TIMEOUTS_MAX     128
+
+//! Static Variables
+static CEventDispatcher *s_initializedEventDispatcher = nullptr;
+
+// the connection an accept handler is running for, acceptSocket and
+// handoffSocket take it over
+static thread_local serverinfo *s_acceptingServer = nullptr;
+static thread_local bool s_acceptingAdmitted = false;
+
+struct CEventDispatcher::PostTask
+{
+    PostTask(const std::function<void ()> &task)
+        : task(task)
+        , next(nullptr)
+    {
+    }
+
+    PostTask(std::function<void ()> &&task)
+        : task(std::move(task))
+        , next(nullptr)
+    {
+    }
+
+    std::function<void ()> task;
+    PostTask *next;
+};
+
+struct CEventDispatcher::DnsEntry
+{
+    std::vector<sockaddr_storage> addresses;
+    c_uint64 expires;
+};
+
+struct CEventDispatcher::DnsRequest
+{
+    DnsRequest(CEventDispatcher *event_dispatcher, const std::string &address)
+        : event_dispatcher(event_dispatcher)
+        , address(address)
+        , pending(2)
+        , ttl(event_dispatcher->m_dns_cache_ttl)
+        , negative(true)
+    {
+    }
+
+    CEventDispatcher *event_dispatcher;
+    std::string address;
+    std::vector<std::pair<socketinfo *, c_uint16>> waiters;
+    std::vector<sockaddr_storage> inet;
+    std::vector<sockaddr_storage> inet6;
+    c_int32 pending;
+    c_uint32 ttl;
+    bool negative;
+};
+
+struct CEventDispatcher::ConnectRace
+{
+    ConnectRace(CEventDispatcher *event_dispatcher, socketinfo *socket_info)
+        : event_dispatcher(event_dispatcher)
+        , socket_info(socket_info)
+        , delay_event(nullptr)
+        , next(0)
+    {
+    }
+
+    CEventDispatcher *event_dispatcher;
+    socketinfo *socket_info;
+    std::vector<sockaddr_storage> addresses;
+    std::vector<event *> attempts;
+    event *delay_event;
+    size_t next;
+};
+
+static inline void initializeThreads()
+{
+    static const auto result =
+#if defined(_WIN32)
+            evthread_use_windows_threads();
+#elif defined(__unix__) || defined(__linux__)
+            evthread_use_pthreads();
+#endif
+
+#if defined(DEBUG)
+    if (result != 0)
+        C_DEBUG("failed to initialize threads");
+#else
+    C_UNUSED(result);
+#endif
+}
 
 #if defined(_WIN32)
 static inline void initializeWSA()
@@ -61,276 +163,721 @@ static inline void initializeWSA()
 }
 #endif
 
-static inline void acceptNotification(evconnlistener *listener, const c_fdptr fd, sockaddr *address, const c_int32 socklen, void *ctx)
+static inline const c_uint64 monotonicTime()
 {
-    C_UNUSED(listener);
-    C_UNUSED(address);
-    C_UNUSED(socklen);
-
-    auto *server_info = reinterpret_cast<serverinfo *>(ctx);
-
-    const auto &accept_handler = serverinfo_get_accept_handler(server_info);
-
-    if (accept_handler)
-        accept_handler(server_info, fd);
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
 }
 
-static inline void acceptErrorNotification(evconnlistener *listener, void *ctx)
+static inline const bool socketName(const c_fdptr fd, sockaddr_storage &sa_stor, const bool peer)
 {
-    C_UNUSED(listener);
+    size_t sa_stor_len = sizeof(sockaddr_storage);
+    memset(&sa_stor, 0, sa_stor_len);
 
-    auto *server_info = reinterpret_cast<serverinfo *>(ctx);
+#if defined(_WIN32)
+    auto *sa_len = reinterpret_cast<c_int32 *>(&sa_stor_len);
+#elif defined(__unix__) || defined(__linux__)
+    auto *sa_len = reinterpret_cast<c_uint32 *>(&sa_stor_len);
+#endif
 
-    const auto &accept_error_handler = serverinfo_get_accept_error_handler(server_info);
+    if (peer)
+        return getpeername(fd, reinterpret_cast<sockaddr *>(&sa_stor), sa_len) == 0;
 
-    if (accept_error_handler)
-        accept_error_handler(server_info, evutil_socket_geterror(evconnlistener_get_fd(listener)));
+    return getsockname(fd, reinterpret_cast<sockaddr *>(&sa_stor), sa_len) == 0;
 }
 
-static inline void readNotification(bufferevent *buffer_event, void *ctx)
+static inline std::string addressString(const sockaddr_storage &sa_stor)
 {
-    C_UNUSED(buffer_event);
+    switch (sa_stor.ss_family) {
+    case AF_INET: {
+        char addr[AF_INET_LENGTH];
+        evutil_inet_ntop(AF_INET, &reinterpret_cast<const sockaddr_in *>(&sa_stor)->sin_addr, addr, AF_INET_LENGTH);
 
-    auto *socket_info = reinterpret_cast<socketinfo *>(ctx);
+        return addr;
+    }
 
-    switch (socketinfo_get_socket_state(socket_info)) {
-    case Connected: {
-        const auto &read_handler = socketinfo_get_read_handler(socket_info);
+    case AF_INET6: {
+        char addr[AF_INET6_LENGTH];
+        evutil_inet_ntop(AF_INET6, &reinterpret_cast<const sockaddr_in6 *>(&sa_stor)->sin6_addr, addr, AF_INET6_LENGTH);
 
-        if (read_handler)
-            read_handler(socket_info);
+        return addr;
+    }
 
-        break;
+#if defined(__unix__) || defined(__linux__)
+    case AF_UNIX: {
+        const auto *sa_un = reinterpret_cast<const sockaddr_un *>(&sa_stor);
+
+        // abstract names start with a nul byte and are not terminated
+        if (sa_un->sun_path[0] == '\0' && sa_un->sun_path[1] != '\0')
+            return '@' + std::string(sa_un->sun_path + 1, strnlen(sa_un->sun_path + 1, sizeof(sa_un->sun_path) - 1));
+
+        return std::string(sa_un->sun_path, strnlen(sa_un->sun_path, sizeof(sa_un->sun_path)));
     }
+#endif
 
     default:
         break;
     }
+
+    return std::string();
 }
 
-static inline void writeNotification(bufferevent *buffer_event, void *ctx)
+#if defined(__unix__) || defined(__linux__)
+static inline const bool localSocketAddress(const std::string &path, sockaddr_un &sa_un, c_int32 &sa_len)
 {
-    auto *socket_info = reinterpret_cast<socketinfo *>(ctx);
-
-    switch (socketinfo_get_socket_state(socket_info)) {
-    case Connected: {
-        const auto &write_handler = socketinfo_get_write_handler(socket_info);
+    if (path.empty() || path.size() >= sizeof(sa_un.sun_path))
+        return false;
 
-        if (write_handler)
-            write_handler(socket_info);
+    memset(&sa_un, 0, sizeof(sockaddr_un));
+    sa_un.sun_family = AF_UNIX;
+    memcpy(sa_un.sun_path, path.data(), path.size());
 
-        break;
+    // a leading '@' names a socket in the linux abstract namespace
+    if (path[0] == '@') {
+        sa_un.sun_path[0] = '\0';
+        sa_len = static_cast<c_int32>(offsetof(sockaddr_un, sun_path) + path.size());
+    } else {
+        sa_len = static_cast<c_int32>(offsetof(sockaddr_un, sun_path) + path.size() + 1);
     }
 
-    case Closing: {
-        if (evbuffer_get_length(bufferevent_get_output(buffer_event)) != 0)
-            break;
+    return true;
+}
+#endif
 
-        bufferevent_free(buffer_event);
+static inline const bool numericAddress(const std::string &address, sockaddr_storage &sa_stor)
+{
+    memset(&sa_stor, 0, sizeof(sockaddr_storage));
 
-        socketinfo_set_bufferevent(socket_info, nullptr);
-        socketinfo_set_socket_state(socket_info, Unconnected);
+    auto *sa_in = reinterpret_cast<sockaddr_in *>(&sa_stor);
 
-        const auto &disconnected_handler = socketinfo_get_disconnected_handler(socket_info);
+    if (evutil_inet_pton(AF_INET, address.c_str(), &sa_in->sin_addr) == 1) {
+        sa_in->sin_family = AF_INET;
+        return true;
+    }
 
-        if (disconnected_handler)
-            disconnected_handler(socket_info);
+    auto *sa_in6 = reinterpret_cast<sockaddr_in6 *>(&sa_stor);
 
-        break;
+    if (evutil_inet_pton(AF_INET6, address.c_str(), &sa_in6->sin6_addr) == 1) {
+        sa_in6->sin6_family = AF_INET6;
+        return true;
     }
 
-    default:
-        break;
-    }
+    return false;
 }
 
-static inline void eventNotification(bufferevent *buffer_event, const c_int16 events, void *ctx)
+static inline const char *hostsFile()
 {
-    auto *socket_info = reinterpret_cast<socketinfo *>(ctx);
+#if defined(_WIN32)
+    const auto *system_root = getenv("SystemRoot");
 
-    if (events & BEV_EVENT_CONNECTED) {
-        socketinfo_set_socket_state(socket_info, Connected);
+    static const std::string hosts_file = std::string(system_root ? system_root : "C:\\Windows") + "\\system32\\drivers\\etc\\hosts";
 
-        auto *ssl_info = socketinfo_get_sslinfo(socket_info);
+    return hosts_file.c_str();
+#elif defined(__unix__) || defined(__linux__)
+    return "/etc/hosts";
+#endif
+}
 
-        if (ssl_info) {
-            const auto &encrypted_handler = sslinfo_get_encrypted_handler(ssl_info);
+static void hostsNotification(const c_int32 result, evutil_addrinfo *res, void *ctx)
+{
+    if (result == 0)
+        *reinterpret_cast<evutil_addrinfo **>(ctx) = res;
+}
 
-            if (encrypted_handler)
-                encrypted_handler(socket_info);
-        } else {
-            const auto &connected_handler = socketinfo_get_connected_handler(socket_info);
+static inline void failConnect(bufferevent *buffer_event)
+{
+    // report through the event callback as a failed lookup would
+    bufferevent_trigger_event(buffer_event, BEV_EVENT_ERROR, BEV_TRIG_DEFER_CALLBACKS);
+}
 
-            if (connected_handler)
-                connected_handler(socket_info);
-        }
+static inline const c_int32 addressLength(sockaddr_storage &sa_stor, const c_uint16 port)
+{
+    switch (sa_stor.ss_family) {
+    case AF_INET:
+        reinterpret_cast<sockaddr_in *>(&sa_stor)->sin_port = htons(port);
+        return sizeof(sockaddr_in);
 
-        return;
+    case AF_INET6:
+        reinterpret_cast<sockaddr_in6 *>(&sa_stor)->sin6_port = htons(port);
+        return sizeof(sockaddr_in6);
+
+    default:
+        break;
     }
 
-    if (events & BEV_EVENT_ERROR) {
-        const auto error = evutil_socket_geterror(bufferevent_getfd(buffer_event));
+    return 0;
+}
 
-        if (error != 0) {
-            const auto &error_handler = socketinfo_get_error_handler(socket_info);
+static inline void connectAddress(bufferevent *buffer_event, const sockaddr_storage &address, const c_uint16 port)
+{
+    auto sa_stor = address;
+    const auto sa_len = addressLength(sa_stor, port);
 
-            if (error_handler)
-                error_handler(socket_info, error);
-        }
+    if (sa_len == 0 || bufferevent_socket_connect(buffer_event, reinterpret_cast<sockaddr *>(&sa_stor), sa_len) != 0)
+        failConnect(buffer_event);
+}
 
-        auto *ssl_info = socketinfo_get_sslinfo(socket_info);
+static inline const c_fdptr connectAttempt(const sockaddr_storage &address)
+{
+    const auto sa_len = address.ss_family == AF_INET6 ? sizeof(sockaddr_in6) : sizeof(sockaddr_in);
 
-        if (ssl_info) {
-            const auto ssl_error = bufferevent_get_openssl_error(buffer_event);
+    auto fd = socket(address.ss_family, SOCK_STREAM, 0);
 
-            if (ssl_error != 0) {
-                const auto &ssl_error_handler = sslinfo_get_ssl_error_handler(ssl_info);
+    if (fd == -1)
+        return -1;
 
-                if (ssl_error_handler)
-                    ssl_error_handler(socket_info, ssl_error);
-            }
+    if (evutil_make_socket_nonblocking(fd) != 0 || evutil_make_socket_closeonexec(fd) != 0) {
+        evutil_closesocket(fd);
+        return -1;
+    }
+
+    if (connect(fd, reinterpret_cast<const sockaddr *>(&address), static_cast<c_int32>(sa_len)) != 0) {
+#if defined(_WIN32)
+        const auto pending = WSAGetLastError() == WSAEWOULDBLOCK;
+#elif defined(__unix__) || defined(__linux__)
+        const auto pending = errno == EINPROGRESS || errno == EINTR;
+#endif
+
+        if (!pending) {
+            evutil_closesocket(fd);
+            return -1;
         }
     }
 
-    if (events & BEV_EVENT_EOF) {
-        bufferevent_free(buffer_event);
+    return fd;
+}
 
-        socketinfo_set_bufferevent(socket_info, nullptr);
-        socketinfo_set_socket_state(socket_info, Unconnected);
+static inline const c_uint16 addressPort(const sockaddr_storage &sa_stor)
+{
+    switch (sa_stor.ss_family) {
+    case AF_INET:
+        return ntohs(reinterpret_cast<const sockaddr_in *>(&sa_stor)->sin_port);
 
-        const auto &disconnected_handler = socketinfo_get_disconnected_handler(socket_info);
+    case AF_INET6:
+        return ntohs(reinterpret_cast<const sockaddr_in6 *>(&sa_stor)->sin6_port);
 
-        if (disconnected_handler)
-            disconnected_handler(socket_info);
+    default:
+        break;
     }
+
+    return 0;
 }
 
-static inline void timerNotification(const c_fdptr fd, const c_int16 events, void *ctx)
+// a connection holds a reference and a unit of load on the info it was
+// accepted by, plus its admission slot when it was counted
+static inline void releaseConnection(serverinfo *server_info, const bool admitted)
 {
-    C_UNUSED(fd);
-    C_UNUSED(events);
+    serverinfo_add_load(server_info, -1);
 
-    auto *timer_info = reinterpret_cast<timerinfo *>(ctx);
+    if (admitted) {
+        auto *admission = serverinfo_get_admission(server_info);
 
-    const auto &timer_handler = timerinfo_get_timer_handler(timer_info);
+        if (serverinfo_release_connection(admission))
+            CEventDispatcher::resumeServers(admission);
 
-    if (timer_handler)
-        timer_handler(timer_info);
+        serverinfo_free(admission);
+    }
+
+    serverinfo_free(server_info);
 }
 
-void CEventDispatcher::acceptSocket(socketinfo *socket_info, const c_fdptr fd)
+static inline void acceptConnection(serverinfo *server_info, const c_fdptr fd, const bool admitted)
 {
-    bufferevent *buffer_event = nullptr;
+    const auto &accept_handler = serverinfo_get_accept_handler(server_info);
 
-    auto *ssl_info = socketinfo_get_sslinfo(socket_info);
+    if (!accept_handler) {
+        evutil_closesocket(fd);
+        releaseConnection(server_info, admitted);
 
-    if (ssl_info) {
-        auto *ssl = SSL_new(sslinfo_get_ssl_context(ssl_info));
+        return;
+    }
 
-        if (!ssl) {
-#if defined(DEBUG)
-            C_DEBUG("failed to initialize ssl");
-#endif
-            return;
-        }
+    s_acceptingServer = server_info;
+    s_acceptingAdmitted = admitted;
 
-        buffer_event = bufferevent_openssl_socket_new(m_event_base, fd, ssl, BUFFEREVENT_SSL_ACCEPTING, BEV_OPT_CLOSE_ON_FREE);
+    accept_handler(server_info, fd);
 
-        if (!buffer_event) {
-            SSL_free(ssl);
-#if defined(DEBUG)
-            C_DEBUG("failed to initialize events");
-#endif
-            return;
-        }
-    } else {
-        buffer_event = bufferevent_socket_new(m_event_base, fd, BEV_OPT_CLOSE_ON_FREE);
+    // the handler neither adopted nor handed off the descriptor
+    if (s_acceptingServer) {
+        s_acceptingServer = nullptr;
 
-        if (!buffer_event) {
-#if defined(DEBUG)
-            C_DEBUG("failed to initialize events");
-#endif
-            return;
-        }
+        releaseConnection(server_info, admitted);
     }
-
-    bufferevent_setcb(buffer_event, readNotification, writeNotification, eventNotification, socket_info);
-
-    socketinfo_set_bufferevent(socket_info, buffer_event);
-    socketinfo_set_socket_state(socket_info, Connected);
 }
 
-void CEventDispatcher::connectSocket(socketinfo *socket_info, const std::string &address, const c_uint16 port)
+static inline void acceptNotification(evconnlistener *listener, const c_fdptr fd, sockaddr *address, const c_int32 socklen, void *ctx)
 {
-    bufferevent *buffer_event = nullptr;
+    C_UNUSED(address);
+    C_UNUSED(socklen);
 
-    auto *ssl_info = socketinfo_get_sslinfo(socket_info);
+    auto *server_info = reinterpret_cast<serverinfo *>(ctx);
 
-    if (ssl_info) {
-        auto *ssl = SSL_new(sslinfo_get_ssl_context(ssl_info));
+    auto admitted = true;
 
-        if (!ssl) {
-#if defined(DEBUG)
-            C_DEBUG("failed to initialize ssl");
-#endif
-            return;
-        }
+    // libevent keeps accepting in this readiness pass until the queue is
+    // empty or the listener is disabled
+    switch (serverinfo_acquire_connection(server_info)) {
+    case AdmittedLast:
+        evconnlistener_disable(listener);
 
-        buffer_event = bufferevent_openssl_socket_new(m_event_base, -1, ssl, BUFFEREVENT_SSL_CONNECTING, BEV_OPT_CLOSE_ON_FREE);
+        break;
 
-        if (!buffer_event) {
-            SSL_free(ssl);
-#if defined(DEBUG)
-            C_DEBUG("failed to initialize events");
-#endif
-            return;
-        }
-    } else {
-        buffer_event = bufferevent_socket_new(m_event_base, -1, BEV_OPT_CLOSE_ON_FREE);
+    case Rejected:
+        evutil_closesocket(fd);
+        evconnlistener_disable(listener);
 
-        if (!buffer_event) {
-#if defined(DEBUG)
-            C_DEBUG("failed to initialize events");
-#endif
-            return;
-        }
-    }
+        return;
 
-    bufferevent_setcb(buffer_event, readNotification, writeNotification, eventNotification, socket_info);
+    case Unlimited:
+        admitted = false;
 
-    if (bufferevent_socket_connect_hostname(buffer_event, m_evdns_base, AF_UNSPEC, address.c_str(), port) != 0) {
-        bufferevent_free(buffer_event);
-#if defined(DEBUG)
-        C_DEBUG("failed to connect");
-#endif
-        return;
+        break;
+
+    default:
+        break;
     }
 
-    socketinfo_set_bufferevent(socket_info, buffer_event);
-    socketinfo_set_socket_state(socket_info, Connecting);
+    serverinfo_add_load(server_info, 1);
+
+    acceptConnection(serverinfo_ref(server_info), fd, admitted);
 }
 
-void CEventDispatcher::closeSocket(socketinfo *socket_info, const bool force)
+static inline void acceptErrorNotification(evconnlistener *listener, void *ctx)
 {
-    auto *buffer_event = socketinfo_get_bufferevent(socket_info);
+    C_UNUSED(listener);
 
-    if (force || evbuffer_get_length(bufferevent_get_output(buffer_event)) == 0) {
-        bufferevent_free(buffer_event);
+    auto *server_info = reinterpret_cast<serverinfo *>(ctx);
 
-        socketinfo_set_bufferevent(socket_info, nullptr);
-        socketinfo_set_socket_state(socket_info, Unconnected);
+    const auto &accept_error_handler = serverinfo_get_accept_error_handler(server_info);
 
-        const auto &disconnected_handler = socketinfo_get_disconnected_handler(socket_info);
+    if (accept_error_handler)
+        accept_error_handler(server_info, evutil_socket_geterror(evconnlistener_get_fd(listener)));
+}
 
-        if (disconnected_handler)
-            disconnected_handler(socket_info);
-    } else {
+static inline void touchSocket(socketinfo *socket_info)
+{
+    if (socketinfo_get_idle_timeout(socket_info) != 0)
+        socketinfo_get_event_dispatcher(socket_info)->touchTimer(socketinfo_get_idle_timer(socket_info));
+}
+
+static inline void idleNotification(timerinfo *timer_info)
+{
+    auto *socket_info = reinterpret_cast<socketinfo *>(timerinfo_get_context(timer_info));
+
+    const auto &timeout_handler = socketinfo_get_timeout_handler(socket_info);
+
+    if (timeout_handler)
+        timeout_handler(socket_info, IdleTimeout);
+}
+
+static inline void readNotification(bufferevent *buffer_event, void *ctx)
+{
+    C_UNUSED(buffer_event);
+
+    auto *socket_info = reinterpret_cast<socketinfo *>(ctx);
+
+    switch (socketinfo_get_socket_state(socket_info)) {
+    case Connected: {
+        touchSocket(socket_info);
+
+        const auto &read_handler = socketinfo_get_read_handler(socket_info);
+
+        if (read_handler)
+            read_handler(socket_info);
+
+        break;
+    }
+
+    default:
+        break;
+    }
+}
+
+static inline void timerNotification(const c_fdptr fd, const c_int16 events, void *ctx)
+{
+    C_UNUSED(fd);
+    C_UNUSED(events);
+
+    auto *timer_info = reinterpret_cast<timerinfo *>(ctx);
+
+    const auto &timer_handler = timerinfo_get_timer_handler(timer_info);
+
+    if (timer_handler)
+        timer_handler(timer_info);
+}
+
+static inline void datagramNotification(const c_fdptr fd, const c_int16 events, void *ctx)
+{
+    C_UNUSED(fd);
+    C_UNUSED(events);
+
+    auto *udp_info = reinterpret_cast<udpinfo *>(ctx);
+
+    const auto &read_handler = udpinfo_get_read_handler(udp_info);
+
+    if (read_handler)
+        read_handler(udp_info);
+}
+
+void CEventDispatcher::acceptSocket(socketinfo *socket_info, const c_fdptr fd)
+{
+    if (m_draining) {
+        evutil_closesocket(fd);
+#if defined(DEBUG)
+        C_DEBUG("event dispatcher is draining");
+#endif
+        return;
+    }
+
+    auto *buffer_event = socketEvent(socket_info, fd, true);
+
+    if (!buffer_event)
+        return;
+
+    // the socket now owns the connection slot, on the failures above it is
+    // released once the accept handler returns
+    socketinfo_set_serverinfo(socket_info, s_acceptingServer, s_acceptingAdmitted);
+
+    s_acceptingServer = nullptr;
+
+    socketinfo_set_event_dispatcher(socket_info, this);
+    socketinfo_set_bufferevent(socket_info, buffer_event);
+    socketinfo_set_socket_state(socket_info, Connected);
+
+    trackSocket(socket_info);
+
+    setSocketTimeouts(socket_info);
+    setSocketWatermarks(socket_info);
+    setSocketRateLimit(socket_info);
+    setSocketCoalescing(socket_info);
+}
+
+void CEventDispatcher::connectSocket(socketinfo *socket_info, const std::string &address, const c_uint16 port)
+{
+    if (m_draining) {
+#if defined(DEBUG)
+        C_DEBUG("event dispatcher is draining");
+#endif
+        return;
+    }
+
+    auto *buffer_event = socketEvent(socket_info, -1, false);
+
+    if (!buffer_event)
+        return;
+
+    socketinfo_set_event_dispatcher(socket_info, this);
+    socketinfo_set_bufferevent(socket_info, buffer_event);
+    socketinfo_set_socket_state(socket_info, Connecting);
+
+    trackSocket(socket_info);
+
+    setSocketTimeouts(socket_info);
+    setSocketWatermarks(socket_info);
+    setSocketRateLimit(socket_info);
+
+    sockaddr_storage sa_stor;
+
+    // numeric addresses never need a lookup
+    if (numericAddress(address, sa_stor))
+        connectAddress(buffer_event, sa_stor, port);
+    else
+        resolveSocket(socket_info, address, port);
+}
+
+void CEventDispatcher::connectLocalSocket(socketinfo *socket_info, const std::string &path)
+{
+#if defined(__unix__) || defined(__linux__)
+    if (m_draining) {
+#   if defined(DEBUG)
+        C_DEBUG("event dispatcher is draining");
+#   endif
+        return;
+    }
+
+    sockaddr_un sa_un;
+    c_int32 sa_len = 0;
+
+    if (!localSocketAddress(path, sa_un, sa_len)) {
+#   if defined(DEBUG)
+        C_DEBUG("invalid local path");
+#   endif
+        return;
+    }
+
+    auto *buffer_event = socketEvent(socket_info, -1, false);
+
+    if (!buffer_event)
+        return;
+
+    if (bufferevent_socket_connect(buffer_event, reinterpret_cast<sockaddr *>(&sa_un), sa_len) != 0) {
+        bufferevent_free(buffer_event);
+#   if defined(DEBUG)
+        C_DEBUG("failed to connect");
+#   endif
+        return;
+    }
+
+    socketinfo_set_event_dispatcher(socket_info, this);
+    socketinfo_set_bufferevent(socket_info, buffer_event);
+    socketinfo_set_socket_state(socket_info, Connecting);
+
+    trackSocket(socket_info);
+
+    setSocketTimeouts(socket_info);
+    setSocketWatermarks(socket_info);
+    setSocketRateLimit(socket_info);
+#else
+    C_UNUSED(socket_info);
+    C_UNUSED(path);
+#   if defined(DEBUG)
+    C_DEBUG("local sockets are not supported");
+#   endif
+#endif
+}
+
+void CEventDispatcher::closeSocket(socketinfo *socket_info, const bool force)
+{
+    auto *buffer_event = socketinfo_get_bufferevent(socket_info);
+
+    // a connecting socket has nothing to flush yet
+    if (force || socketinfo_get_socket_state(socket_info) == Connecting || evbuffer_get_length(bufferevent_get_output(buffer_event)) == 0)
+        disconnectSocket(socket_info, buffer_event);
+    else
         socketinfo_set_socket_state(socket_info, Closing);
+}
+
+void CEventDispatcher::setSocketTimeouts(socketinfo *socket_info)
+{
+    auto *buffer_event = socketinfo_get_bufferevent(socket_info);
+
+    if (!buffer_event)
+        return;
+
+    const auto read_timeout = socketinfo_get_read_timeout(socket_info);
+    const auto write_timeout = socketinfo_get_write_timeout(socket_info);
+
+    bufferevent_set_timeouts(buffer_event, read_timeout != 0 ? timerTimeout(read_timeout) : nullptr, write_timeout != 0 ? timerTimeout(write_timeout) : nullptr);
+
+    auto *idle_timer = socketinfo_get_idle_timer(socket_info);
+    const auto idle_timeout = socketinfo_get_idle_timeout(socket_info);
+
+    if (idle_timeout != 0) {
+        if (!timerinfo_get_timer_handler(idle_timer))
+            timerinfo_set_timer_handler(idle_timer, idleNotification);
+
+        startTimer(idle_timer, idle_timeout, false);
+    } else {
+        killTimer(idle_timer);
+    }
+}
+
+void CEventDispatcher::setSocketCoalescing(socketinfo *socket_info)
+{
+    auto *buffer_event = socketinfo_get_bufferevent(socket_info);
+
+    if (!buffer_event)
+        return;
+
+    const auto fd = bufferevent_getfd(buffer_event);
+
+    if (fd < 0)
+        return;
+
+#if defined(TCP_CORK)
+    const c_int32 flag = socketinfo_get_coalescing(socket_info) ? 1 : 0;
+
+    if (setsockopt(fd, IPPROTO_TCP, TCP_CORK, &flag, sizeof(c_int32)) != 0) {
+#   if defined(DEBUG)
+        C_DEBUG("failed to set cork");
+#   endif
+        return;
+    }
+
+    if (flag == 0 && socketinfo_get_flush_pending(socket_info))
+        flushSocket(socket_info);
+#else
+#   if defined(DEBUG)
+    if (socketinfo_get_coalescing(socket_info))
+        C_DEBUG("write coalescing is not supported");
+#   endif
+#endif
+}
+
+void CEventDispatcher::setSocketWatermarks(socketinfo *socket_info)
+{
+    auto *buffer_event = socketinfo_get_bufferevent(socket_info);
+
+    if (!buffer_event)
+        return;
+
+    bufferevent_setwatermark(buffer_event, EV_READ, socketinfo_get_read_low_watermark(socket_info), socketinfo_get_read_high_watermark(socket_info));
+
+    // libevent has no use for a write high watermark, checkSocketWatermarks
+    // enforces it; the low one makes the write notification fire on drain
+    bufferevent_setwatermark(buffer_event, EV_WRITE, socketinfo_get_write_low_watermark(socket_info), 0);
+
+    checkSocketWatermarks(socket_info);
+}
+
+void CEventDispatcher::checkSocketWatermarks(socketinfo *socket_info)
+{
+    const auto write_high_watermark = socketinfo_get_write_high_watermark(socket_info);
+    auto *buffer_event = socketinfo_get_bufferevent(socket_info);
+
+    if (!buffer_event)
+        return;
+
+    const auto len = evbuffer_get_length(bufferevent_get_output(buffer_event));
+
+    if (!socketinfo_get_write_full(socket_info)) {
+        if (write_high_watermark == 0 || len < write_high_watermark)
+            return;
+
+        socketinfo_set_write_full(socket_info, true);
+
+        const auto &write_full_handler = socketinfo_get_write_full_handler(socket_info);
+
+        if (write_full_handler)
+            write_full_handler(socket_info);
+
+        return;
+    }
+
+    if (len > socketinfo_get_write_low_watermark(socket_info) && write_high_watermark != 0)
+        return;
+
+    socketinfo_set_write_full(socket_info, false);
+
+    const auto &write_drained_handler = socketinfo_get_write_drained_handler(socket_info);
+
+    if (write_drained_handler)
+        write_drained_handler(socket_info);
+}
+
+void CEventDispatcher::setSocketRateLimit(socketinfo *socket_info)
+{
+    auto *buffer_event = socketinfo_get_bufferevent(socket_info);
+
+    if (!buffer_event)
+        return;
+
+    auto *rate_limit = socketinfo_get_rate_limit(socket_info);
+    auto *rate_limit_group = socketinfo_get_rate_limit_group(socket_info);
+
+    if (rate_limit_group && (rate_limit_group->m_event_dispatcher != this || !rate_limit_group->m_rate_limit_group)) {
+#if defined(DEBUG)
+        C_DEBUG("rate limit group belongs to another event dispatcher");
+#endif
+        rate_limit_group = nullptr;
+    }
+
+    if (bufferevent_set_rate_limit(buffer_event, rate_limit) != 0) {
+#if defined(DEBUG)
+        C_DEBUG("failed to set rate limit");
+#endif
+    }
+
+    bufferevent_remove_from_rate_limit_group(buffer_event);
+
+    if (rate_limit_group && bufferevent_add_to_rate_limit_group(buffer_event, rate_limit_group->m_rate_limit_group) != 0) {
+#if defined(DEBUG)
+        C_DEBUG("failed to join rate limit group");
+#endif
+    }
+
+    auto *input = bufferevent_get_input(buffer_event);
+    auto *output = bufferevent_get_output(buffer_event);
+
+    evbuffer_remove_cb(input, rateLimitNotification, socket_info);
+    evbuffer_remove_cb(output, rateLimitNotification, socket_info);
+
+    // throttling is only counted while some bucket applies to the socket
+    if (rate_limit || rate_limit_group) {
+        evbuffer_add_cb(input, rateLimitNotification, socket_info);
+        evbuffer_add_cb(output, rateLimitNotification, socket_info);
+    }
+}
+
+void CEventDispatcher::setSocketNotifications(socketinfo *socket_info)
+{
+    auto *buffer_event = socketinfo_get_bufferevent(socket_info);
+
+    if (!buffer_event)
+        return;
+
+    // the callbacks every socket starts with, they run the socket delegates
+    bufferevent_setcb(buffer_event, readNotification, socketWriteNotification, socketEventNotification, socket_info);
+}
+
+void CEventDispatcher::flushSocket(socketinfo *socket_info, const bool deferred)
+{
+    if (deferred) {
+        if (socketinfo_get_flush_pending(socket_info))
+            return;
+
+        socketinfo_set_flush_pending(socket_info, true);
+
+        // activated at the tail of the active queue, so it runs once this
+        // pass has delivered all of its write notifications
+        if (m_flush_sockets.empty())
+            event_active(m_flush_event, EV_WRITE, 0);
+
+        m_flush_sockets.push_back(socket_info);
+
+        return;
+    }
+
+    if (socketinfo_get_flush_pending(socket_info)) {
+        socketinfo_set_flush_pending(socket_info, false);
+
+        for (auto it = m_flush_sockets.begin(); it != m_flush_sockets.end(); ++it) {
+            if (*it == socket_info) {
+                m_flush_sockets.erase(it);
+
+                break;
+            }
+        }
     }
+
+#if defined(TCP_CORK)
+    auto *buffer_event = socketinfo_get_bufferevent(socket_info);
+
+    if (!buffer_event)
+        return;
+
+    const auto fd = bufferevent_getfd(buffer_event);
+
+    if (fd < 0)
+        return;
+
+    // pulling the cork pushes out the partial segment the kernel held back
+    c_int32 flag = 0;
+    setsockopt(fd, IPPROTO_TCP, TCP_CORK, &flag, sizeof(c_int32));
+
+    if (!socketinfo_get_coalescing(socket_info))
+        return;
+
+    flag = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_CORK, &flag, sizeof(c_int32));
+#endif
 }
 
-void CEventDispatcher::bindServer(serverinfo *server_info, const std::string &address, const c_uint16 port, const c_int32 backlog)
+void CEventDispatcher::bindServer(serverinfo *server_info, const std::string &address, const c_uint16 port, const c_int32 backlog, const bool reusePort)
 {
+    // thread safe so a connection released on another loop can resume it
+    c_uint32 flags = LEV_OPT_CLOSE_ON_FREE | LEV_OPT_CLOSE_ON_EXEC | LEV_OPT_REUSEABLE | LEV_OPT_THREADSAFE;
+
+    if (reusePort) {
+#if defined(LEV_OPT_REUSEABLE_PORT)
+        flags |= LEV_OPT_REUSEABLE_PORT;
+#else
+#   if defined(DEBUG)
+        C_DEBUG("port reuse is not supported");
+#   endif
+        return;
+#endif
+    }
+
     evutil_addrinfo hints;
     memset(&hints, 0, sizeof(evutil_addrinfo));
     hints.ai_family = AF_UNSPEC;
@@ -346,294 +893,1546 @@ void CEventDispatcher::bindServer(serverinfo *server_info, const std::string &ad
         return;
     }
 
-    evconnlistener *ev_conn_listener = nullptr;
+    evconnlistener *ev_conn_listener = nullptr;
+
+    switch (addr_info->ai_family) {
+    case AF_INET:
+        ev_conn_listener = evconnlistener_new_bind(m_event_base, acceptNotification, server_info, flags, backlog, addr_info->ai_addr, static_cast<c_int32>(sizeof(sockaddr_in)));
+
+        break;
+
+    case AF_INET6:
+        ev_conn_listener = evconnlistener_new_bind(m_event_base, acceptNotification, server_info, flags, backlog, addr_info->ai_addr, static_cast<c_int32>(sizeof(sockaddr_in6)));
+
+        break;
+
+    default:
+        evutil_freeaddrinfo(addr_info);
+
+        return;
+    }
+
+    if (!ev_conn_listener) {
+        evutil_freeaddrinfo(addr_info);
+#if defined(DEBUG)
+        C_DEBUG("failed to bind listener");
+#endif
+        return;
+    }
+
+    evutil_freeaddrinfo(addr_info);
+
+    registerServer(server_info, ev_conn_listener);
+}
+
+void CEventDispatcher::bindLocalServer(serverinfo *server_info, const std::string &path, const c_int32 backlog)
+{
+#if defined(__unix__) || defined(__linux__)
+    sockaddr_un sa_un;
+    c_int32 sa_len = 0;
+
+    if (!localSocketAddress(path, sa_un, sa_len)) {
+#   if defined(DEBUG)
+        C_DEBUG("invalid local path");
+#   endif
+        return;
+    }
+
+    // a socket file left behind by a previous run would make bind fail
+    struct stat st;
+
+    if (path[0] != '@' && stat(path.c_str(), &st) == 0 && S_ISSOCK(st.st_mode))
+        unlink(path.c_str());
+
+    const c_uint32 flags = LEV_OPT_CLOSE_ON_FREE | LEV_OPT_CLOSE_ON_EXEC | LEV_OPT_THREADSAFE;
+
+    auto *ev_conn_listener = evconnlistener_new_bind(m_event_base, acceptNotification, server_info, flags, backlog, reinterpret_cast<sockaddr *>(&sa_un), sa_len);
+
+    if (!ev_conn_listener) {
+#   if defined(DEBUG)
+        C_DEBUG("failed to bind listener");
+#   endif
+        return;
+    }
+
+    registerServer(server_info, ev_conn_listener);
+#else
+    C_UNUSED(server_info);
+    C_UNUSED(path);
+    C_UNUSED(backlog);
+#   if defined(DEBUG)
+    C_DEBUG("local sockets are not supported");
+#   endif
+#endif
+}
+
+void CEventDispatcher::closeServer(serverinfo *server_info)
+{    
+    auto *ev_conn_listener = serverinfo_get_evconnlistener(server_info);
+
+#if defined(__unix__) || defined(__linux__)
+    sockaddr_storage sa_stor;
+
+    // remove the socket file, abstract names vanish with the descriptor
+    if (socketName(evconnlistener_get_fd(ev_conn_listener), sa_stor, false) && sa_stor.ss_family == AF_UNIX) {
+        const auto *sa_un = reinterpret_cast<const sockaddr_un *>(&sa_stor);
+
+        if (sa_un->sun_path[0] != '\0')
+            unlink(sa_un->sun_path);
+    }
+#endif
+
+    evconnlistener_free(ev_conn_listener);
+
+    serverinfo_set_evconnlistener(server_info, nullptr);
+    serverinfo_remove_listener(server_info);
+
+    m_servers.erase(std::remove(m_servers.begin(), m_servers.end(), server_info), m_servers.end());
+}
+
+void CEventDispatcher::bindDatagram(udpinfo *udp_info, const std::string &address, const c_uint16 port)
+{
+    evutil_addrinfo hints;
+    memset(&hints, 0, sizeof(evutil_addrinfo));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_DGRAM;
+    hints.ai_protocol = IPPROTO_UDP;
+    hints.ai_flags = EVUTIL_AI_PASSIVE;
+
+    evutil_addrinfo *addr_info = nullptr;
+
+    if (evutil_getaddrinfo(address.empty() ? nullptr : address.c_str(), std::to_string(port).c_str(), &hints, &addr_info) != 0) {
+#if defined(DEBUG)
+        C_DEBUG("invalid address or port");
+#endif
+        return;
+    }
+
+    const c_fdptr fd = socket(addr_info->ai_family, SOCK_DGRAM, IPPROTO_UDP);
+
+    if (fd < 0) {
+        evutil_freeaddrinfo(addr_info);
+#if defined(DEBUG)
+        C_DEBUG("failed to create socket");
+#endif
+        return;
+    }
+
+    if (evutil_make_socket_nonblocking(fd) != 0 || evutil_make_socket_closeonexec(fd) != 0
+            || bind(fd, addr_info->ai_addr, static_cast<c_int32>(addr_info->ai_addrlen)) != 0) {
+        evutil_closesocket(fd);
+        evutil_freeaddrinfo(addr_info);
+#if defined(DEBUG)
+        C_DEBUG("failed to bind socket");
+#endif
+        return;
+    }
+
+    evutil_freeaddrinfo(addr_info);
+
+    auto *ev = event_new(m_event_base, fd, EV_READ | EV_PERSIST, datagramNotification, udp_info);
+
+    if (!ev || event_add(ev, nullptr) != 0) {
+        if (ev)
+            event_free(ev);
+
+        evutil_closesocket(fd);
+#if defined(DEBUG)
+        C_DEBUG("failed to initialize events");
+#endif
+        return;
+    }
+
+    udpinfo_set_event(udp_info, ev);
+    udpinfo_set_event_dispatcher(udp_info, this);
+}
+
+void CEventDispatcher::closeDatagram(udpinfo *udp_info)
+{
+    auto *ev = udpinfo_get_event(udp_info);
+
+    if (!ev)
+        return;
+
+    const auto fd = event_get_fd(ev);
+
+    event_free(ev);
+    evutil_closesocket(fd);
+
+    udpinfo_set_event(udp_info, nullptr);
+}
+
+void CEventDispatcher::bindWorker(serverinfo *server_info)
+{
+    if (serverinfo_get_handoff_event(server_info))
+        return;
+
+    auto *ev = event_new(m_event_base, -1, 0, handoffNotification, server_info);
+
+    if (!ev) {
+#if defined(DEBUG)
+        C_DEBUG("failed to initialize worker");
+#endif
+        return;
+    }
+
+    serverinfo_set_event_dispatcher(server_info, this);
+    serverinfo_set_handoff_event(server_info, ev);
+}
+
+void CEventDispatcher::closeWorker(serverinfo *server_info)
+{
+    auto *ev = serverinfo_get_handoff_event(server_info);
+
+    if (!ev)
+        return;
+
+    event_free(ev);
+
+    serverinfo_set_handoff_event(server_info, nullptr);
+    serverinfo_set_handoff_pending(server_info, false);
+
+    // descriptors nobody picked up yet
+    c_fdptr fd;
+    bool admitted;
+
+    while (serverinfo_handoff_pop(server_info, fd, admitted)) {
+        evutil_closesocket(fd);
+        releaseConnection(server_info, admitted);
+    }
+}
+
+void CEventDispatcher::handoffSocket(serverinfo *server_info, const c_fdptr fd)
+{
+    // the connection moves from the accepting listener to the worker
+    auto *accepting_server = s_acceptingServer;
+    const auto admitted = accepting_server && s_acceptingAdmitted;
+
+    s_acceptingServer = nullptr;
+
+    serverinfo_ref(server_info);
+    serverinfo_add_load(server_info, 1);
+
+    if (accepting_server) {
+        serverinfo_add_load(accepting_server, -1);
+        serverinfo_free(accepting_server);
+    }
+
+    auto *ev = serverinfo_get_handoff_event(server_info);
+
+    if (!ev) {
+        evutil_closesocket(fd);
+        releaseConnection(server_info, admitted);
+#if defined(DEBUG)
+        C_DEBUG("worker is not bound");
+#endif
+        return;
+    }
+
+    // a full queue falls back to the allocating post queue, the reference
+    // keeps the worker info alive until the task runs
+    if (!serverinfo_handoff_push(server_info, fd, admitted)) {
+        post([server_info, fd, admitted]() {
+            if (serverinfo_get_handoff_event(server_info)) {
+                acceptConnection(server_info, fd, admitted);
+
+                return;
+            }
+
+            evutil_closesocket(fd);
+            releaseConnection(server_info, admitted);
+        });
+
+        return;
+    }
+
+    // only the push that finds the worker idle wakes it up
+    if (!serverinfo_set_handoff_pending(server_info, true))
+        event_active(ev, EV_READ, 1);
+}
+
+void CEventDispatcher::startTimer(timerinfo *timer_info, const c_uint32 msec, const bool repeat)
+{
+    if (timerinfo_get_timer_type(timer_info) == CoarseTimer) {
+        if (timerwheel_count(m_timer_wheel) == 0) {
+            timeval tv;
+            tv.tv_sec = m_timer_wheel_tick / 1000;
+            tv.tv_usec = (m_timer_wheel_tick % 1000) * 1000;
+
+            if (event_add(m_timer_wheel_event, &tv) != 0) {
+#if defined(DEBUG)
+                C_DEBUG("failed to initialize timer");
+#endif
+                return;
+            }
+
+            m_timer_wheel_time = monotonicTime();
+        }
+
+        timerinfo_set_interval(timer_info, msec);
+        timerinfo_set_repeat(timer_info, repeat);
+
+        timerwheel_add(m_timer_wheel, timer_info, (static_cast<c_uint64>(msec) + m_timer_wheel_tick - 1) / m_timer_wheel_tick, repeat);
+
+        return;
+    }
+
+    const c_int16 events = repeat ? (EV_TIMEOUT | EV_PERSIST) : EV_TIMEOUT;
+
+    auto *ev = timerinfo_get_event(timer_info);
+
+    // the event is allocated once and reassigned only when its flags or
+    // base change, a plain re-arm is just another event_add
+    if (!ev) {
+        ev = event_new(m_event_base, -1, events, timerNotification, timer_info);
+
+        if (!ev) {
+#if defined(DEBUG)
+            C_DEBUG("failed to initialize timer");
+#endif
+            return;
+        }
+
+        timerinfo_set_event(timer_info, ev);
+    } else if (event_get_base(ev) != m_event_base || event_get_events(ev) != events) {
+        event_del(ev);
+
+        if (event_assign(ev, m_event_base, -1, events, timerNotification, timer_info) != 0) {
+#if defined(DEBUG)
+            C_DEBUG("failed to initialize timer");
+#endif
+            return;
+        }
+    }
+
+    timerinfo_set_interval(timer_info, msec);
+    timerinfo_set_repeat(timer_info, repeat);
+
+    if (event_add(ev, timerTimeout(msec)) != 0) {
+#if defined(DEBUG)
+        C_DEBUG("invalid timer interval");
+#endif
+        return;
+    }
+}
+
+void CEventDispatcher::restartTimer(timerinfo *timer_info, const c_uint32 msec, const bool repeat)
+{
+    startTimer(timer_info, msec, repeat);
+}
+
+void CEventDispatcher::touchTimer(timerinfo *timer_info)
+{
+    startTimer(timer_info, timerinfo_get_interval(timer_info), timerinfo_get_repeat(timer_info));
+}
+
+void CEventDispatcher::touchTimers(timerinfo * const *timer_infos, const size_t count)
+{
+    for (size_t i = 0; i < count; ++i)
+        startTimer(timer_infos[i], timerinfo_get_interval(timer_infos[i]), timerinfo_get_repeat(timer_infos[i]));
+}
+
+void CEventDispatcher::killTimer(timerinfo *timer_info)
+{
+    if (timerinfo_get_timer_type(timer_info) == CoarseTimer) {
+        timerwheel_remove(m_timer_wheel, timer_info);
+
+        if (timerwheel_count(m_timer_wheel) == 0)
+            event_del(m_timer_wheel_event);
+
+        return;
+    }
+
+    auto *ev = timerinfo_get_event(timer_info);
+
+    if (ev)
+        event_del(ev);
+}
+
+void CEventDispatcher::post(const std::function<void ()> &task)
+{
+    pushPostTask(new PostTask(task));
+}
+
+void CEventDispatcher::post(std::function<void ()> &&task)
+{
+    pushPostTask(new PostTask(std::move(task)));
+}
+
+void CEventDispatcher::invoke(const std::function<void ()> &task)
+{
+    const auto thread_id = m_thread_id.load(std::memory_order_acquire);
+
+    // nobody runs the loop or we are on its thread already, run in place
+    if (thread_id == std::thread::id() || thread_id == std::this_thread::get_id()) {
+        task();
+
+        return;
+    }
+
+    std::promise<void> done;
+
+    post([&task, &done]() {
+        task();
+        done.set_value();
+    });
+
+    done.get_future().wait();
+}
+
+void CEventDispatcher::drain(const c_uint32 msec)
+{
+    if (m_draining)
+        return;
+
+    m_draining = true;
+
+    for (auto *server_info : m_servers)
+        evconnlistener_disable(serverinfo_get_evconnlistener(server_info));
+
+    if (msec != 0) {
+        if (!m_drain_event)
+            m_drain_event = event_new(m_event_base, -1, 0, drainNotification, this);
+
+        timeval tv;
+        tv.tv_sec = msec / 1000;
+        tv.tv_usec = (msec % 1000) * 1000;
+
+        if (!m_drain_event || event_add(m_drain_event, &tv) != 0) {
+#if defined(DEBUG)
+            C_DEBUG("failed to initialize drain deadline");
+#endif
+        }
+    }
+
+    // walk from the back, closing a socket removes it by swapping the last
+    // one into its slot and disconnected handlers may close others
+    for (auto i = m_sockets.size(); i-- > 0;) {
+        if (i >= m_sockets.size())
+            continue;
+
+        auto *socket_info = m_sockets[i];
+
+        if (socketinfo_get_socket_state(socket_info) != Closing)
+            closeSocket(socket_info);
+    }
+
+    if (m_sockets.empty())
+        finishDrain();
+}
+
+void CEventDispatcher::clearDnsCache()
+{
+    for (auto &dns_entry : m_dns_cache)
+        delete dns_entry.second;
+
+    m_dns_cache.clear();
+}
+
+const c_int32 CEventDispatcher::execute()
+{
+    const auto thread_id = m_thread_id.exchange(std::this_thread::get_id(), std::memory_order_acq_rel);
+
+    const auto result = event_base_dispatch(m_event_base);
+
+    m_thread_id.store(thread_id, std::memory_order_release);
+
+#if defined(DEBUG)
+    if (result != 0)
+        C_DEBUG("internal error");
+#endif
+
+    return result;
+}
+
+const c_int32 CEventDispatcher::execute(const EventLoopFlag eventLoopFlag)
+{
+    c_int32 flag = 0;
+
+    switch (eventLoopFlag) {
+    case Once:
+        flag = EVLOOP_ONCE;
+
+        break;
+
+    case NonBlock:
+        flag = EVLOOP_NONBLOCK;
+
+        break;
+
+    case NoExitOnEmpty:
+        flag = EVLOOP_NO_EXIT_ON_EMPTY;
+
+        break;
+
+    default:
+#if defined(DEBUG)
+        C_DEBUG("invalid event loop flag");
+#endif
+        return -1;
+    }
+
+    const auto thread_id = m_thread_id.exchange(std::this_thread::get_id(), std::memory_order_acq_rel);
+
+    const auto result = event_base_loop(m_event_base, flag);
+
+    m_thread_id.store(thread_id, std::memory_order_release);
+
+#if defined(DEBUG)
+    if (result != 0)
+        C_DEBUG("internal error");
+#endif
+
+    return result;
+}
+
+const c_int32 CEventDispatcher::terminate()
+{
+#if defined(DEBUG)
+    const auto result = event_base_loopbreak(m_event_base);
+
+    if (result != 0)
+        C_DEBUG("internal error");
+
+    return result;
+#else
+    return event_base_loopbreak(m_event_base);
+#endif
+}
+
+const bool CEventDispatcher::isDraining() const
+{
+    return m_draining;
+}
+
+void CEventDispatcher::resumeServers(serverinfo *server_info)
+{
+    // each listener is enabled on its own loop, unless it was closed, the
+    // loop is draining, the user disabled it or the limit was hit again
+    for (auto *listener : serverinfo_ref_listeners(server_info)) {
+        auto *event_dispatcher = serverinfo_get_event_dispatcher(listener);
+
+        event_dispatcher->post([event_dispatcher, listener]() {
+            auto *ev_conn_listener = serverinfo_get_evconnlistener(listener);
+
+            if (ev_conn_listener && !event_dispatcher->m_draining && serverinfo_get_enabled(listener) && !serverinfo_get_paused(listener))
+                evconnlistener_enable(ev_conn_listener);
+
+            serverinfo_free(listener);
+        });
+    }
+}
+
+std::string CEventDispatcher::socketAddress(const c_fdptr fd)
+{
+    sockaddr_storage sa_stor;
+
+    if (!socketName(fd, sa_stor, true))
+        return std::string();
+
+    return addressString(sa_stor);
+}
+
+std::string CEventDispatcher::localAddress(const c_fdptr fd)
+{
+    sockaddr_storage sa_stor;
+
+    if (!socketName(fd, sa_stor, false))
+        return std::string();
+
+    return addressString(sa_stor);
+}
+
+CEventDispatcher *CEventDispatcher::initialize(const CEventDispatcherConfig &config)
+{
+    static CEventDispatcher eventDispatcher(config);
+
+    s_initializedEventDispatcher = &eventDispatcher;
+
+    infopool_reserve(eventDispatcher.m_preallocated_infos);
+
+    return &eventDispatcher;
+}
+
+CEventDispatcher *CEventDispatcher::instance()
+{
+    if (s_initializedEventDispatcher)
+        return s_initializedEventDispatcher;
+
+    static CEventDispatcher eventDispatcher;
+
+    return &eventDispatcher;
+}
+
+const c_uint16 CEventDispatcher::socketPort(const c_fdptr fd)
+{
+    sockaddr_storage sa_stor;
+
+    if (!socketName(fd, sa_stor, true))
+        return 0;
+
+    return addressPort(sa_stor);
+}
+
+const c_uint16 CEventDispatcher::localPort(const c_fdptr fd)
+{
+    sockaddr_storage sa_stor;
+
+    if (!socketName(fd, sa_stor, false))
+        return 0;
+
+    return addressPort(sa_stor);
+}
+
+void CEventDispatcher::socketConnected(socketinfo *socket_info)
+{
+    socketinfo_set_socket_state(socket_info, Connected);
+    socketinfo_get_event_dispatcher(socket_info)->setSocketCoalescing(socket_info);
+}
+
+void CEventDispatcher::socketWritten(socketinfo *socket_info)
+{
+    touchSocket(socket_info);
+
+    auto *event_dispatcher = socketinfo_get_event_dispatcher(socket_info);
+
+    if (socketinfo_get_coalescing(socket_info))
+        event_dispatcher->flushSocket(socket_info, true);
+
+    event_dispatcher->checkSocketWatermarks(socket_info);
+}
+
+void CEventDispatcher::socketWriteNotification(bufferevent *buffer_event, void *ctx)
+{
+    auto *socket_info = reinterpret_cast<socketinfo *>(ctx);
+
+    switch (socketinfo_get_socket_state(socket_info)) {
+    case Connected: {
+        socketWritten(socket_info);
+
+        const auto &write_handler = socketinfo_get_write_handler(socket_info);
+
+        if (write_handler)
+            write_handler(socket_info);
+
+        break;
+    }
+
+    case Closing: {
+        if (evbuffer_get_length(bufferevent_get_output(buffer_event)) != 0)
+            break;
+
+        disconnectSocket(socket_info, buffer_event);
+
+        break;
+    }
+
+    default:
+        break;
+    }
+}
+
+void CEventDispatcher::socketEventNotification(bufferevent *buffer_event, const c_int16 events, void *ctx)
+{
+    auto *socket_info = reinterpret_cast<socketinfo *>(ctx);
+
+    if (events & BEV_EVENT_CONNECTED) {
+        socketConnected(socket_info);
+
+        auto *ssl_info = socketinfo_get_sslinfo(socket_info);
+
+        if (ssl_info) {
+            const auto &encrypted_handler = sslinfo_get_encrypted_handler(ssl_info);
+
+            if (encrypted_handler)
+                encrypted_handler(socket_info);
+        } else {
+            const auto &connected_handler = socketinfo_get_connected_handler(socket_info);
+
+            if (connected_handler)
+                connected_handler(socket_info);
+        }
+
+        return;
+    }
+
+    if (events & BEV_EVENT_TIMEOUT) {
+        const auto &timeout_handler = socketinfo_get_timeout_handler(socket_info);
+
+        if (timeout_handler)
+            timeout_handler(socket_info, (events & BEV_EVENT_READING) ? ReadTimeout : WriteTimeout);
+
+        // libevent disables the timed out direction, keep the socket usable
+        // unless the handler closed it
+        if (socketinfo_get_bufferevent(socket_info) == buffer_event)
+            bufferevent_enable(buffer_event, (events & BEV_EVENT_READING) ? EV_READ : EV_WRITE);
+
+        return;
+    }
+
+    if (events & BEV_EVENT_ERROR) {
+        const auto error = evutil_socket_geterror(bufferevent_getfd(buffer_event));
+
+        if (error != 0) {
+            const auto &error_handler = socketinfo_get_error_handler(socket_info);
+
+            if (error_handler)
+                error_handler(socket_info, error);
+        }
+
+        auto *ssl_info = socketinfo_get_sslinfo(socket_info);
+
+        if (ssl_info) {
+            const auto ssl_error = bufferevent_get_openssl_error(buffer_event);
+
+            if (ssl_error != 0) {
+                const auto &ssl_error_handler = sslinfo_get_ssl_error_handler(ssl_info);
+
+                if (ssl_error_handler)
+                    ssl_error_handler(socket_info, ssl_error);
+            }
+        }
+    }
+
+    if (events & BEV_EVENT_EOF)
+        disconnectSocket(socket_info, buffer_event);
+}
+
+CEventDispatcher::CEventDispatcher()
+    : m_event_base(nullptr)
+    , m_evdns_base(nullptr)
+    , m_hosts_base(nullptr)
+    , m_post_event(nullptr)
+    , m_timer_wheel_event(nullptr)
+    , m_flush_event(nullptr)
+    , m_drain_event(nullptr)
+    , m_timer_wheel(timerwheel_new())
+    , m_post_tasks(nullptr)
+    , m_thread_id()
+    , m_timer_wheel_time(0)
+    , m_timer_wheel_tick(CEVENTDISPATCHER_COARSE_TIMER_TICK)
+    , m_preallocated_infos(CEVENTDISPATCHER_PREALLOCATED_INFOS)
+    , m_dns_cache_size(CEVENTDISPATCHER_DNS_CACHE_SIZE)
+    , m_dns_cache_ttl(CEVENTDISPATCHER_DNS_CACHE_TTL)
+    , m_dns_negative_ttl(CEVENTDISPATCHER_DNS_NEGATIVE_TTL)
+    , m_connect_attempt_delay(CEVENTDISPATCHER_CONNECT_ATTEMPT_DELAY)
+    , m_draining(false)
+{
+#if defined(_WIN32)
+    initializeWSA();
+#endif
+
+    initializeThreads();
+
+    m_event_base = event_base_new();
+
+    initializeBase();
+}
+
+CEventDispatcher::CEventDispatcher(const CEventDispatcherConfig &config)
+    : m_event_base(nullptr)
+    , m_evdns_base(nullptr)
+    , m_hosts_base(nullptr)
+    , m_post_event(nullptr)
+    , m_timer_wheel_event(nullptr)
+    , m_flush_event(nullptr)
+    , m_drain_event(nullptr)
+    , m_timer_wheel(timerwheel_new())
+    , m_post_tasks(nullptr)
+    , m_thread_id()
+    , m_timer_wheel_time(0)
+    , m_timer_wheel_tick(config.m_coarse_timer_tick)
+    , m_preallocated_infos(config.m_preallocated_infos)
+    , m_dns_cache_size(config.m_dns_cache_size)
+    , m_dns_cache_ttl(config.m_dns_cache_ttl)
+    , m_dns_negative_ttl(config.m_dns_negative_ttl)
+    , m_connect_attempt_delay(config.m_connect_attempt_delay)
+    , m_draining(false)
+{
+#if defined(_WIN32)
+    initializeWSA();
+#endif
+
+    initializeThreads();
+
+    m_event_base = event_base_new_with_config(config.m_event_config);
+
+    initializeBase();
+}
+
+CEventDispatcher::~CEventDispatcher()
+{
+#if defined(_WIN32)
+    WSACleanup();
+#endif
+
+    auto *post_task = m_post_tasks.exchange(nullptr);
+
+    while (post_task) {
+        auto *next = post_task->next;
+        delete post_task;
+        post_task = next;
+    }
+
+    timerwheel_free(m_timer_wheel);
+
+    if (m_drain_event)
+        event_free(m_drain_event);
+
+    if (m_flush_event)
+        event_free(m_flush_event);
+
+    if (m_timer_wheel_event)
+        event_free(m_timer_wheel_event);
+
+    if (m_post_event)
+        event_free(m_post_event);
+
+    while (!m_connect_races.empty())
+        finishRace(m_connect_races.begin()->second, -1);
+
+    clearDnsCache();
+
+    if (m_hosts_base)
+        evdns_base_free(m_hosts_base, 1);
+
+    if (m_evdns_base)
+        evdns_base_free(m_evdns_base, 1);
+
+    // failed lookups only report back from the loop, which never runs again
+    for (auto &dns_request : m_dns_requests)
+        delete dns_request.second;
+
+    m_dns_requests.clear();
+
+    if (m_event_base)
+        event_base_free(m_event_base);
+}
+
+void CEventDispatcher::initializeBase()
+{
+    if (!m_event_base) {
+#if defined(DEBUG)
+        C_DEBUG("failed to initialize");
+#endif
+        return;
+    }
+
+    m_evdns_base = evdns_base_new(m_event_base, 1);
+    m_hosts_base = evdns_base_new(m_event_base, 0);
+    m_post_event = event_new(m_event_base, -1, 0, postNotification, this);
+    m_timer_wheel_event = event_new(m_event_base, -1, EV_PERSIST, timerWheelNotification, this);
+    m_flush_event = event_new(m_event_base, -1, 0, flushNotification, this);
+
+    // the hosts file lives in a base of its own, without nameservers, so a
+    // name missing from it never reaches the network
+    if (m_hosts_base)
+        evdns_base_load_hosts(m_hosts_base, hostsFile());
+
+    if (!m_evdns_base || !m_hosts_base || !m_post_event || !m_timer_wheel_event || !m_flush_event) {
+        if (m_flush_event) {
+            event_free(m_flush_event);
+            m_flush_event = nullptr;
+        }
+
+        if (m_timer_wheel_event) {
+            event_free(m_timer_wheel_event);
+            m_timer_wheel_event = nullptr;
+        }
+
+        if (m_post_event) {
+            event_free(m_post_event);
+            m_post_event = nullptr;
+        }
+
+        if (m_hosts_base) {
+            evdns_base_free(m_hosts_base, 1);
+            m_hosts_base = nullptr;
+        }
+
+        if (m_evdns_base) {
+            evdns_base_free(m_evdns_base, 1);
+            m_evdns_base = nullptr;
+        }
+
+        event_base_free(m_event_base);
+        m_event_base = nullptr;
+#if defined(DEBUG)
+        C_DEBUG("failed to initialize");
+#endif
+    }
+}
+
+void CEventDispatcher::timerWheelNotification(const c_fdptr fd, const c_int16 events, void *ctx)
+{
+    C_UNUSED(fd);
+    C_UNUSED(events);
+
+    auto *eventDispatcher = reinterpret_cast<CEventDispatcher *>(ctx);
+
+    const auto ticks = (monotonicTime() - eventDispatcher->m_timer_wheel_time) / eventDispatcher->m_timer_wheel_tick;
+
+    if (ticks == 0)
+        return;
+
+    eventDispatcher->m_timer_wheel_time += ticks * eventDispatcher->m_timer_wheel_tick;
+
+    timerwheel_advance(eventDispatcher->m_timer_wheel, ticks);
+
+    if (timerwheel_count(eventDispatcher->m_timer_wheel) == 0)
+        event_del(eventDispatcher->m_timer_wheel_event);
+}
+
+bufferevent *CEventDispatcher::socketEvent(socketinfo *socket_info, const c_fdptr fd, const bool accepting)
+{
+    bufferevent *buffer_event = nullptr;
+
+    auto *ssl_info = socketinfo_get_sslinfo(socket_info);
+
+    if (ssl_info) {
+        auto *ssl = SSL_new(sslinfo_get_ssl_context(ssl_info));
+
+        if (!ssl) {
+#if defined(DEBUG)
+            C_DEBUG("failed to initialize ssl");
+#endif
+            return nullptr;
+        }
+
+        buffer_event = bufferevent_openssl_socket_new(m_event_base, fd, ssl, accepting ? BUFFEREVENT_SSL_ACCEPTING : BUFFEREVENT_SSL_CONNECTING, BEV_OPT_CLOSE_ON_FREE);
+
+        if (!buffer_event) {
+            SSL_free(ssl);
+#if defined(DEBUG)
+            C_DEBUG("failed to initialize events");
+#endif
+            return nullptr;
+        }
+    } else {
+        buffer_event = bufferevent_socket_new(m_event_base, fd, BEV_OPT_CLOSE_ON_FREE);
+
+        if (!buffer_event) {
+#if defined(DEBUG)
+            C_DEBUG("failed to initialize events");
+#endif
+            return nullptr;
+        }
+    }
+
+    bufferevent_setcb(buffer_event, readNotification, socketWriteNotification, socketEventNotification, socket_info);
+    bufferevent_enable(buffer_event, EV_READ | EV_WRITE);
+
+    return buffer_event;
+}
+
+void CEventDispatcher::registerServer(serverinfo *server_info, evconnlistener *ev_conn_listener)
+{
+    evconnlistener_set_error_cb(ev_conn_listener, acceptErrorNotification);
+
+    serverinfo_set_evconnlistener(server_info, ev_conn_listener);
+    serverinfo_add_listener(server_info);
+
+    m_servers.push_back(server_info);
+
+    if (m_draining)
+        evconnlistener_disable(ev_conn_listener);
+}
+
+void CEventDispatcher::trackSocket(socketinfo *socket_info)
+{
+    socketinfo_set_index(socket_info, m_sockets.size());
+
+    m_sockets.push_back(socket_info);
+}
+
+void CEventDispatcher::untrackSocket(socketinfo *socket_info)
+{
+    const auto index = socketinfo_get_index(socket_info);
+
+    if (index >= m_sockets.size() || m_sockets[index] != socket_info)
+        return;
+
+    m_sockets[index] = m_sockets.back();
+    socketinfo_set_index(m_sockets[index], index);
+    m_sockets.pop_back();
+
+    if (m_draining && m_sockets.empty())
+        finishDrain();
+}
+
+void CEventDispatcher::finishDrain()
+{
+    if (!m_draining)
+        return;
+
+    m_draining = false;
+
+    if (m_drain_event)
+        event_del(m_drain_event);
+
+    event_base_loopexit(m_event_base, nullptr);
+}
+
+void CEventDispatcher::resolveSocket(socketinfo *socket_info, const std::string &address, const c_uint16 port)
+{
+    auto *buffer_event = socketinfo_get_bufferevent(socket_info);
+
+    const auto it = m_dns_cache.find(address);
+
+    if (it != m_dns_cache.end()) {
+        auto *dns_entry = it->second;
+
+        if (dns_entry->expires > monotonicTime()) {
+            if (dns_entry->addresses.empty())
+                failConnect(buffer_event);
+            else
+                connectAddresses(socket_info, dns_entry->addresses, port);
+
+            return;
+        }
+
+        delete dns_entry;
+        m_dns_cache.erase(it);
+    }
+
+    evutil_addrinfo hints;
+    memset(&hints, 0, sizeof(evutil_addrinfo));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_protocol = IPPROTO_TCP;
+    hints.ai_flags = EVUTIL_AI_ADDRCONFIG;
+
+    evutil_addrinfo *res = nullptr;
+
+    // names from the hosts file are answered before this returns, anything
+    // else is left to the nameservers
+    auto *hosts_request = evdns_getaddrinfo(m_hosts_base, address.c_str(), nullptr, &hints, hostsNotification, &res);
+
+    if (hosts_request)
+        evdns_getaddrinfo_cancel(hosts_request);
+
+    if (res) {
+        std::vector<sockaddr_storage> addresses;
+
+        for (auto *ai = res; ai; ai = ai->ai_next) {
+            if ((ai->ai_family != AF_INET && ai->ai_family != AF_INET6) || ai->ai_addrlen > sizeof(sockaddr_storage))
+                continue;
+
+            sockaddr_storage sa_stor;
+            memset(&sa_stor, 0, sizeof(sockaddr_storage));
+            memcpy(&sa_stor, ai->ai_addr, ai->ai_addrlen);
+
+            addresses.push_back(sa_stor);
+        }
+
+        evutil_freeaddrinfo(res);
+
+        if (addresses.empty())
+            failConnect(buffer_event);
+        else
+            connectAddresses(socket_info, addresses, port);
+
+        return;
+    }
+
+    // sockets asking for a name that is already being looked up wait on
+    // the same request
+    auto &pending_request = m_dns_requests[address];
+
+    if (pending_request) {
+        pending_request->waiters.emplace_back(socket_info, port);
+        return;
+    }
+
+    auto *dns_request = new DnsRequest(this, address);
+    dns_request->waiters.emplace_back(socket_info, port);
+
+    pending_request = dns_request;
+
+    // the address records are asked for directly, their answers carry the
+    // ttl the cache has to respect
+    if (!evdns_base_resolve_ipv4(m_evdns_base, address.c_str(), 0, dnsNotification, dns_request))
+        dnsNotification(DNS_ERR_UNKNOWN, 0, 0, 0, nullptr, dns_request);
+
+    if (!evdns_base_resolve_ipv6(m_evdns_base, address.c_str(), 0, dnsNotification, dns_request))
+        dnsNotification(DNS_ERR_UNKNOWN, 0, 0, 0, nullptr, dns_request);
+}
+
+void CEventDispatcher::connectAddresses(socketinfo *socket_info, const std::vector<sockaddr_storage> &addresses, const c_uint16 port)
+{
+    if (m_connect_attempt_delay == 0 || addresses.size() < 2) {
+        connectAddress(socketinfo_get_bufferevent(socket_info), addresses.front(), port);
+        return;
+    }
+
+    auto *connect_race = new ConnectRace(this, socket_info);
+    connect_race->delay_event = event_new(m_event_base, -1, 0, attemptDelayNotification, connect_race);
+
+    // alternate the families, ipv6 first, so a broken path of one family
+    // only costs a single attempt delay
+    std::vector<sockaddr_storage> inet6;
+    std::vector<sockaddr_storage> inet;
+
+    for (const auto &address : addresses)
+        (address.ss_family == AF_INET6 ? inet6 : inet).push_back(address);
+
+    for (size_t i = 0; i < inet6.size() || i < inet.size(); ++i) {
+        if (i < inet6.size())
+            connect_race->addresses.push_back(inet6[i]);
+
+        if (i < inet.size())
+            connect_race->addresses.push_back(inet[i]);
+    }
+
+    for (auto &address : connect_race->addresses)
+        addressLength(address, port);
+
+    m_connect_races[socket_info] = connect_race;
+
+    startAttempt(connect_race);
+}
+
+void CEventDispatcher::startAttempt(ConnectRace *connect_race)
+{
+    while (connect_race->next < connect_race->addresses.size()) {
+        const auto fd = connectAttempt(connect_race->addresses[connect_race->next++]);
+
+        if (fd == -1)
+            continue;
 
-    switch (addr_info->ai_family) {
-    case AF_INET:
-        ev_conn_listener = evconnlistener_new_bind(m_event_base, acceptNotification, server_info, (LEV_OPT_CLOSE_ON_FREE | LEV_OPT_REUSEABLE), backlog, addr_info->ai_addr, static_cast<c_int32>(sizeof(sockaddr_in)));
+        auto *attempt = event_new(m_event_base, fd, EV_WRITE, attemptNotification, connect_race);
 
-        break;
+        if (!attempt || event_add(attempt, nullptr) != 0) {
+            if (attempt)
+                event_free(attempt);
 
-    case AF_INET6:
-        ev_conn_listener = evconnlistener_new_bind(m_event_base, acceptNotification, server_info, (LEV_OPT_CLOSE_ON_FREE | LEV_OPT_REUSEABLE), backlog, addr_info->ai_addr, static_cast<c_int32>(sizeof(sockaddr_in6)));
+            evutil_closesocket(fd);
+            continue;
+        }
 
-        break;
+        connect_race->attempts.push_back(attempt);
 
-    default:
-        evutil_freeaddrinfo(addr_info);
+        if (connect_race->next < connect_race->addresses.size() && connect_race->delay_event)
+            event_add(connect_race->delay_event, timerTimeout(m_connect_attempt_delay));
 
         return;
     }
 
-    if (!ev_conn_listener) {
-        evutil_freeaddrinfo(addr_info);
-#if defined(DEBUG)
-        C_DEBUG("failed to bind listener");
-#endif
-        return;
+    if (connect_race->attempts.empty()) {
+        auto *buffer_event = socketinfo_get_bufferevent(connect_race->socket_info);
+
+        finishRace(connect_race, -1);
+        failConnect(buffer_event);
     }
+}
 
-    evutil_freeaddrinfo(addr_info);
+void CEventDispatcher::finishRace(ConnectRace *connect_race, const c_fdptr fd)
+{
+    m_connect_races.erase(connect_race->socket_info);
 
-    evconnlistener_set_error_cb(ev_conn_listener, acceptErrorNotification);
+    for (auto *attempt : connect_race->attempts) {
+        const auto attempt_fd = event_get_fd(attempt);
 
-    serverinfo_set_evconnlistener(server_info, ev_conn_listener);
-}
+        event_free(attempt);
 
-void CEventDispatcher::closeServer(serverinfo *server_info)
-{    
-    evconnlistener_free(serverinfo_get_evconnlistener(server_info));
+        if (attempt_fd != fd)
+            evutil_closesocket(attempt_fd);
+    }
 
-    serverinfo_set_evconnlistener(server_info, nullptr);
+    if (connect_race->delay_event)
+        event_free(connect_race->delay_event);
+
+    delete connect_race;
 }
 
-void CEventDispatcher::startTimer(timerinfo *timer_info, const c_uint32 msec, const bool repeat)
+void CEventDispatcher::cancelConnect(socketinfo *socket_info)
 {
-    c_int16 events = repeat ? (EV_TIMEOUT | EV_PERSIST) : EV_TIMEOUT;
+    const auto it = m_connect_races.find(socket_info);
 
-    auto *ev = event_new(m_event_base, -1, events, timerNotification, timer_info);
-
-    if (!ev) {
-#if defined(DEBUG)
-        C_DEBUG("failed to initialize timer");
-#endif
+    if (it != m_connect_races.end()) {
+        finishRace(it->second, -1);
         return;
     }
 
-    timeval tv;
-    tv.tv_sec = msec / 1000;
-    tv.tv_usec = (msec % 1000) * 1000;
+    for (auto &dns_request : m_dns_requests) {
+        for (auto &waiter : dns_request.second->waiters) {
+            if (waiter.first == socket_info) {
+                waiter.first = nullptr;
+                return;
+            }
+        }
+    }
+}
 
-    if (event_add(ev, &tv) != 0) {
-        event_free(ev);
-#if defined(DEBUG)
-        C_DEBUG("invalid timer interval");
-#endif
+void CEventDispatcher::cacheAddresses(const std::string &address, const std::vector<sockaddr_storage> &addresses, const c_uint32 ttl)
+{
+    if (m_dns_cache_size == 0 || ttl == 0)
         return;
+
+    const auto now = monotonicTime();
+
+    auto it = m_dns_cache.find(address);
+
+    if (it == m_dns_cache.end()) {
+        // make room by dropping expired entries, or the one closest to expiry
+        if (m_dns_cache.size() >= m_dns_cache_size) {
+            auto victim = m_dns_cache.end();
+
+            for (auto entry = m_dns_cache.begin(); entry != m_dns_cache.end();) {
+                if (entry->second->expires <= now) {
+                    delete entry->second;
+                    entry = m_dns_cache.erase(entry);
+                    continue;
+                }
+
+                if (victim == m_dns_cache.end() || entry->second->expires < victim->second->expires)
+                    victim = entry;
+
+                ++entry;
+            }
+
+            if (m_dns_cache.size() >= m_dns_cache_size && victim != m_dns_cache.end()) {
+                delete victim->second;
+                m_dns_cache.erase(victim);
+            }
+        }
+
+        it = m_dns_cache.emplace(address, new DnsEntry).first;
     }
 
-    timerinfo_set_event(timer_info, ev);
+    it->second->addresses = addresses;
+    it->second->expires = now + ttl;
 }
 
-void CEventDispatcher::restartTimer(timerinfo *timer_info, const c_uint32 msec, const bool repeat)
+const timeval *CEventDispatcher::timerTimeout(const c_uint32 msec)
 {
-    killTimer(timer_info);
-    startTimer(timer_info, msec, repeat);
-}
+    // timers sharing an interval go through libevent common timeouts,
+    // which keeps them in a queue instead of the min-heap
+    auto it = m_timer_timeouts.find(msec);
 
-void CEventDispatcher::killTimer(timerinfo *timer_info)
-{
-    event_free(timerinfo_get_event(timer_info));
+    if (it != m_timer_timeouts.end())
+        return &it->second;
+
+    timeval tv;
+    tv.tv_sec = msec / 1000;
+    tv.tv_usec = (msec % 1000) * 1000;
+
+    const timeval *common_tv = nullptr;
 
-    timerinfo_set_event(timer_info, nullptr);
+    if (m_timer_timeouts.size() < COMMON_TIMEOUTS_MAX)
+        common_tv = event_base_init_common_timeout(m_event_base, &tv);
+
+    if (!common_tv)
+        common_tv = &tv;
+
+    return &(m_timer_timeouts[msec] = *common_tv);
 }
 
-const c_int32 CEventDispatcher::execute()
+void CEventDispatcher::pushPostTask(PostTask *post_task)
 {
-#if defined(DEBUG)
-    const auto result = event_base_dispatch(m_event_base);
+    auto *head = m_post_tasks.load(std::memory_order_relaxed);
 
-    if (result != 0)
-        C_DEBUG("internal error");
+    do {
+        post_task->next = head;
+    } while (!m_post_tasks.compare_exchange_weak(head, post_task, std::memory_order_release, std::memory_order_relaxed));
 
-    return result;
-#else
-    return event_base_dispatch(m_event_base);
-#endif
+    // only the task that finds the queue empty wakes the loop up, the rest
+    // of the batch is picked up by the same notification
+    if (!head)
+        event_active(m_post_event, EV_READ, 1);
 }
 
-const c_int32 CEventDispatcher::execute(const EventLoopFlag eventLoopFlag)
+void CEventDispatcher::disconnectSocket(socketinfo *socket_info, bufferevent *buffer_event)
 {
-    c_int32 flag = 0;
+    auto *event_dispatcher = socketinfo_get_event_dispatcher(socket_info);
 
-    switch (eventLoopFlag) {
-    case Once:
-        flag = EVLOOP_ONCE;
+    // a connecting socket without a descriptor is still waiting on a lookup
+    // or racing its addresses
+    if (socketinfo_get_socket_state(socket_info) == Connecting && bufferevent_getfd(buffer_event) == -1)
+        event_dispatcher->cancelConnect(socket_info);
 
-        break;
+    event_dispatcher->killTimer(socketinfo_get_idle_timer(socket_info));
+    event_dispatcher->untrackSocket(socket_info);
 
-    case NonBlock:
-        flag = EVLOOP_NONBLOCK;
+    if (socketinfo_get_flush_pending(socket_info))
+        event_dispatcher->flushSocket(socket_info);
 
-        break;
+    socketinfo_set_write_full(socket_info, false);
 
-    case NoExitOnEmpty:
-        flag = EVLOOP_NO_EXIT_ON_EMPTY;
+    // libevent finalizes freed bufferevents on the next loop pass, drop the
+    // buckets now so they can be freed even if the loop never runs again
+    if (socketinfo_get_rate_limit(socket_info))
+        bufferevent_set_rate_limit(buffer_event, nullptr);
 
-        break;
+    if (socketinfo_get_rate_limit_group(socket_info))
+        bufferevent_remove_from_rate_limit_group(buffer_event);
 
-    default:
-#if defined(DEBUG)
-        C_DEBUG("invalid event loop flag");
-#endif
-        return -1;
-    }
+    bufferevent_free(buffer_event);
 
-#if defined(DEBUG)
-    const auto result = event_base_loop(m_event_base, flag);
+    socketinfo_set_bufferevent(socket_info, nullptr);
+    socketinfo_set_socket_state(socket_info, Unconnected);
 
-    if (result != 0)
-        C_DEBUG("internal error");
+    // give back the slot of an accepted connection
+    auto *server_info = socketinfo_get_serverinfo(socket_info);
 
-    return result;
-#else
-    return event_base_loop(m_event_base, flag);
-#endif
-}
+    if (server_info) {
+        const auto admitted = socketinfo_get_admitted(socket_info);
 
-const c_int32 CEventDispatcher::terminate()
-{
-#if defined(DEBUG)
-    const auto result = event_base_loopbreak(m_event_base);
+        socketinfo_set_serverinfo(socket_info, nullptr, false);
 
-    if (result != 0)
-        C_DEBUG("internal error");
+        releaseConnection(server_info, admitted);
+    }
 
-    return result;
-#else
-    return event_base_loopbreak(m_event_base);
-#endif
+    const auto &disconnected_handler = socketinfo_get_disconnected_handler(socket_info);
+
+    if (disconnected_handler)
+        disconnected_handler(socket_info);
 }
 
-std::string CEventDispatcher::socketAddress(const c_fdptr fd)
+void CEventDispatcher::postNotification(const c_fdptr fd, const c_int16 events, void *ctx)
 {
-    sockaddr_storage sa_stor;
-    size_t sa_stor_len = sizeof(sockaddr_storage);
-    memset(&sa_stor, 0, sa_stor_len);
+    C_UNUSED(fd);
+    C_UNUSED(events);
 
-#if defined(_WIN32)
-    if (getpeername(fd, reinterpret_cast<sockaddr *>(&sa_stor), reinterpret_cast<c_int32 *>(&sa_stor_len)) != 0)
-#elif defined(__unix__) || defined(__linux__)
-    if (getpeername(fd, reinterpret_cast<sockaddr *>(&sa_stor), reinterpret_cast<c_uint32 *>(&sa_stor_len)) != 0)
-#endif
-        return std::string();
+    auto *eventDispatcher = reinterpret_cast<CEventDispatcher *>(ctx);
 
-    switch (sa_stor.ss_family) {
-    case AF_INET: {
-        char addr[AF_INET_LENGTH];
-        evutil_inet_ntop(AF_INET, &reinterpret_cast<sockaddr_in *>(&sa_stor)->sin_addr, addr, AF_INET_LENGTH);
+    // the producers push onto a lock-free stack, take it as a whole batch
+    // and restore the posting order before running it
+    auto *post_task = eventDispatcher->m_post_tasks.exchange(nullptr, std::memory_order_acquire);
 
-        return addr;
+    PostTask *batch = nullptr;
+
+    while (post_task) {
+        auto *next = post_task->next;
+        post_task->next = batch;
+        batch = post_task;
+        post_task = next;
     }
 
-    case AF_INET6: {
-        char addr[AF_INET6_LENGTH];
-        evutil_inet_ntop(AF_INET6, &reinterpret_cast<sockaddr_in6 *>(&sa_stor)->sin6_addr, addr, AF_INET6_LENGTH);
+    while (batch) {
+        auto *next = batch->next;
 
-        return addr;
-    }
+        batch->task();
 
-    default:
-        break;
+        delete batch;
+        batch = next;
     }
-
-    return std::string();
 }
 
-CEventDispatcher *CEventDispatcher::initialize(const CEventDispatcherConfig &config)
+void CEventDispatcher::handoffNotification(const c_fdptr fd, const c_int16 events, void *ctx)
 {
-    static CEventDispatcher eventDispatcher(config);
+    C_UNUSED(fd);
+    C_UNUSED(events);
 
-    return &eventDispatcher;
+    auto *server_info = reinterpret_cast<serverinfo *>(ctx);
+
+    // clear the flag before draining, a push racing with the drain either
+    // lands in this batch or activates the event again
+    serverinfo_set_handoff_pending(server_info, false);
+
+    c_fdptr socket_fd;
+    bool admitted;
+
+    while (serverinfo_handoff_pop(server_info, socket_fd, admitted))
+        acceptConnection(server_info, socket_fd, admitted);
 }
 
-CEventDispatcher *CEventDispatcher::instance()
+void CEventDispatcher::drainNotification(const c_fdptr fd, const c_int16 events, void *ctx)
 {
-    static CEventDispatcher eventDispatcher;
+    C_UNUSED(fd);
+    C_UNUSED(events);
 
-    return &eventDispatcher;
+    auto *eventDispatcher = reinterpret_cast<CEventDispatcher *>(ctx);
+
+    // the deadline passed, drop whatever output is still queued
+    while (!eventDispatcher->m_sockets.empty()) {
+        auto *socket_info = eventDispatcher->m_sockets.back();
+
+        disconnectSocket(socket_info, socketinfo_get_bufferevent(socket_info));
+    }
+
+    eventDispatcher->finishDrain();
 }
 
-const c_uint16 CEventDispatcher::socketPort(const c_fdptr fd)
+void CEventDispatcher::flushNotification(const c_fdptr fd, const c_int16 events, void *ctx)
 {
-    sockaddr_storage sa_stor;
-    size_t sa_stor_len = sizeof(sockaddr_storage);
-    memset(&sa_stor, 0, sa_stor_len);
-
-#if defined(_WIN32)
-    if (getpeername(fd, reinterpret_cast<sockaddr *>(&sa_stor), reinterpret_cast<c_int32 *>(&sa_stor_len)) != 0)
-#elif defined(__unix__) || defined(__linux__)
-    if (getpeername(fd, reinterpret_cast<sockaddr *>(&sa_stor), reinterpret_cast<c_uint32 *>(&sa_stor_len)) != 0)
-#endif
-        return 0;
+    C_UNUSED(fd);
+    C_UNUSED(events);
 
-    switch (sa_stor.ss_family) {
-    case AF_INET:
-        return ntohs(reinterpret_cast<sockaddr_in *>(&sa_stor)->sin_port);
+    auto *eventDispatcher = reinterpret_cast<CEventDispatcher *>(ctx);
 
-    case AF_INET6:
-        return ntohs(reinterpret_cast<sockaddr_in6 *>(&sa_stor)->sin6_port);
+    std::vector<socketinfo *> flush_sockets;
+    flush_sockets.swap(eventDispatcher->m_flush_sockets);
 
-    default:
-        break;
+    for (auto *socket_info : flush_sockets) {
+        socketinfo_set_flush_pending(socket_info, false);
+        eventDispatcher->flushSocket(socket_info);
     }
 
-    return 0;
+    // keep the capacity for the next pass
+    if (eventDispatcher->m_flush_sockets.empty()) {
+        flush_sockets.clear();
+        flush_sockets.swap(eventDispatcher->m_flush_sockets);
+    }
 }
 
-CEventDispatcher::CEventDispatcher()
-    : m_event_base(nullptr)
-    , m_evdns_base(nullptr)
+void CEventDispatcher::rateLimitNotification(evbuffer *buffer, const evbuffer_cb_info *info, void *ctx)
 {
-#if defined(_WIN32)
-    initializeWSA();
-#endif
+    auto *socket_info = reinterpret_cast<socketinfo *>(ctx);
+    auto *buffer_event = socketinfo_get_bufferevent(socket_info);
 
-    m_event_base = event_base_new();
+    if (!buffer_event)
+        return;
 
-    if (m_event_base) {
-        m_evdns_base = evdns_base_new(m_event_base, 1);
+    auto *rate_limit_group = socketinfo_get_rate_limit_group(socket_info);
+    auto *group = rate_limit_group ? rate_limit_group->m_rate_limit_group : nullptr;
 
-        if (!m_evdns_base) {
-            event_base_free(m_event_base);
-#if defined(DEBUG)
-            C_DEBUG("failed to initialize");
-#endif
-        }
-    }
-#if defined(DEBUG)
-    else {
-        C_DEBUG("failed to initialize");
+    // libevent charges the buckets right after this callback, so a bucket
+    // is exhausted once the transferred bytes reach what it had left
+    if (buffer == bufferevent_get_input(buffer_event)) {
+        if (info->n_added == 0)
+            return;
+
+        const auto len = static_cast<ev_ssize_t>(info->n_added);
+
+        if (socketinfo_get_rate_limit(socket_info) && bufferevent_get_read_limit(buffer_event) <= len)
+            socketinfo_set_read_throttled(socket_info, socketinfo_get_read_throttled(socket_info) + 1);
+
+        if (group && bufferevent_rate_limit_group_get_read_limit(group) <= len)
+            rate_limit_group->m_read_throttled.fetch_add(1, std::memory_order_relaxed);
+    } else {
+        if (info->n_deleted == 0)
+            return;
+
+        const auto len = static_cast<ev_ssize_t>(info->n_deleted);
+
+        if (socketinfo_get_rate_limit(socket_info) && bufferevent_get_write_limit(buffer_event) <= len)
+            socketinfo_set_write_throttled(socket_info, socketinfo_get_write_throttled(socket_info) + 1);
+
+        if (group && bufferevent_rate_limit_group_get_write_limit(group) <= len)
+            rate_limit_group->m_write_throttled.fetch_add(1, std::memory_order_relaxed);
     }
-#endif
 }
 
-CEventDispatcher::CEventDispatcher(const CEventDispatcherConfig &config)
-    : m_event_base(nullptr)
-    , m_evdns_base(nullptr)
+void CEventDispatcher::attemptNotification(const c_fdptr fd, const c_int16 events, void *ctx)
 {
-#if defined(_WIN32)
-    initializeWSA();
-#endif
+    C_UNUSED(events);
 
-    m_event_base = event_base_new_with_config(config.m_event_config);
+    auto *connect_race = reinterpret_cast<ConnectRace *>(ctx);
+    auto *eventDispatcher = connect_race->event_dispatcher;
 
-    if (m_event_base) {
-        m_evdns_base = evdns_base_new(m_event_base, 1);
+    c_int32 error = 0;
+    auto error_len = static_cast<socklen_t>(sizeof(error));
 
-        if (!m_evdns_base) {
-            event_base_free(m_event_base);
-#if defined(DEBUG)
-            C_DEBUG("failed to initialize");
-#endif
-        }
+    if (getsockopt(fd, SOL_SOCKET, SO_ERROR, reinterpret_cast<char *>(&error), &error_len) != 0)
+        error = -1;
+
+    if (error == 0) {
+        auto *buffer_event = socketinfo_get_bufferevent(connect_race->socket_info);
+        const auto ssl = socketinfo_get_sslinfo(connect_race->socket_info) != nullptr;
+
+        eventDispatcher->finishRace(connect_race, fd);
+
+        // an ssl bufferevent starts its handshake once it has a descriptor
+        // and reports the connection itself when that is done
+        bufferevent_setfd(buffer_event, fd);
+
+        if (!ssl)
+            bufferevent_trigger_event(buffer_event, BEV_EVENT_CONNECTED, BEV_TRIG_DEFER_CALLBACKS);
+
+        return;
     }
-#if defined(DEBUG)
-    else {
-        C_DEBUG("failed to initialize");
+
+    auto &attempts = connect_race->attempts;
+
+    for (auto it = attempts.begin(); it != attempts.end(); ++it) {
+        if (event_get_fd(*it) == fd) {
+            event_free(*it);
+            attempts.erase(it);
+            break;
+        }
     }
-#endif
+
+    evutil_closesocket(fd);
+
+    // a failed attempt lets the next address go without waiting out the delay
+    if (connect_race->delay_event)
+        event_del(connect_race->delay_event);
+
+    eventDispatcher->startAttempt(connect_race);
 }
 
-CEventDispatcher::~CEventDispatcher()
+void CEventDispatcher::attemptDelayNotification(const c_fdptr fd, const c_int16 events, void *ctx)
 {
-#if defined(_WIN32)
-    WSACleanup();
-#endif
+    C_UNUSED(fd);
+    C_UNUSED(events);
 
-    if (m_event_base)
-        event_base_free(m_event_base);
+    auto *connect_race = reinterpret_cast<ConnectRace *>(ctx);
 
-    if (m_evdns_base)
-        evdns_base_free(m_evdns_base, 1);
+    connect_race->event_dispatcher->startAttempt(connect_race);
+}
+
+void CEventDispatcher::dnsNotification(const c_int32 result, const char type, const c_int32 count, const c_int32 ttl, void *addresses, void *ctx)
+{
+    auto *dns_request = reinterpret_cast<DnsRequest *>(ctx);
+
+    if (result == DNS_ERR_NONE) {
+        for (c_int32 i = 0; i < count; ++i) {
+            sockaddr_storage sa_stor;
+            memset(&sa_stor, 0, sizeof(sockaddr_storage));
+
+            if (type == DNS_IPv4_A) {
+                auto *sa_in = reinterpret_cast<sockaddr_in *>(&sa_stor);
+                sa_in->sin_family = AF_INET;
+                sa_in->sin_addr = reinterpret_cast<const in_addr *>(addresses)[i];
+
+                dns_request->inet.push_back(sa_stor);
+            } else if (type == DNS_IPv6_AAAA) {
+                auto *sa_in6 = reinterpret_cast<sockaddr_in6 *>(&sa_stor);
+                sa_in6->sin6_family = AF_INET6;
+                sa_in6->sin6_addr = reinterpret_cast<const in6_addr *>(addresses)[i];
+
+                dns_request->inet6.push_back(sa_stor);
+            }
+        }
+
+        // the configured ttl only caps what the records allow
+        dns_request->ttl = static_cast<c_uint32>(std::min<c_uint64>(dns_request->ttl, static_cast<c_uint64>(std::max(ttl, 0)) * 1000));
+    } else if (result != DNS_ERR_NOTEXIST && result != DNS_ERR_NODATA) {
+        // only a missing name or record is worth remembering, timeouts and
+        // server failures are asked again by the next connect
+        dns_request->negative = false;
+    }
+
+    if (--dns_request->pending != 0)
+        return;
+
+    auto *eventDispatcher = dns_request->event_dispatcher;
+    eventDispatcher->m_dns_requests.erase(dns_request->address);
+
+    // ipv4 first, a single attempt must not depend on a working ipv6 path
+    auto &resolved = dns_request->inet;
+    resolved.insert(resolved.end(), dns_request->inet6.begin(), dns_request->inet6.end());
+
+    if (!resolved.empty())
+        eventDispatcher->cacheAddresses(dns_request->address, resolved, dns_request->ttl);
+    else if (dns_request->negative)
+        eventDispatcher->cacheAddresses(dns_request->address, resolved, eventDispatcher->m_dns_negative_ttl);
+
+    for (const auto &waiter : dns_request->waiters) {
+        if (!waiter.first)
+            continue;
+
+        auto *buffer_event = socketinfo_get_bufferevent(waiter.first);
+
+        if (!buffer_event)
+            continue;
+
+        if (resolved.empty())
+            failConnect(buffer_event);
+        else
+            eventDispatcher->connectAddresses(waiter.first, resolved, waiter.second);
+    }
+
+    delete dns_request;
 }
@@ -25,6 +25,14 @@
 #ifndef CEVENTDISPATCHER_H
 #define CEVENTDISPATCHER_H
 
+//! Std Includes
+#include <atomic>
+#include <functional>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
 //! LibEvent Includes
 #include <event2/event.h>
 #include <event2/buffer.h>
@@ -46,23 +54,55 @@ public:
 
     void acceptSocket(socketinfo *socket_info, const c_fdptr fd);
     void connectSocket(socketinfo *socket_info, const std::string &address, const c_uint16 port);
+    void connectLocalSocket(socketinfo *socket_info, const std::string &path);
     void closeSocket(socketinfo *socket_info, const bool force = false);
-    void bindServer(serverinfo *server_info, const std::string &address, const c_uint16 port, const c_int32 backlog = -1);
+    void setSocketTimeouts(socketinfo *socket_info);
+    void setSocketCoalescing(socketinfo *socket_info);
+    void setSocketWatermarks(socketinfo *socket_info);
+    void checkSocketWatermarks(socketinfo *socket_info);
+    void setSocketRateLimit(socketinfo *socket_info);
+    void setSocketNotifications(socketinfo *socket_info);
+    void flushSocket(socketinfo *socket_info, const bool deferred = false);
+    void bindServer(serverinfo *server_info, const std::string &address, const c_uint16 port, const c_int32 backlog = -1, const bool reusePort = false);
+    void bindLocalServer(serverinfo *server_info, const std::string &path, const c_int32 backlog = -1);
     void closeServer(serverinfo *server_info);
+    void bindDatagram(udpinfo *udp_info, const std::string &address, const c_uint16 port);
+    void closeDatagram(udpinfo *udp_info);
+    void bindWorker(serverinfo *server_info);
+    void closeWorker(serverinfo *server_info);
+    void handoffSocket(serverinfo *server_info, const c_fdptr fd);
     void startTimer(timerinfo *timer_info, const c_uint32 msec, const bool repeat = true);
     void restartTimer(timerinfo *timer_info, const c_uint32 msec, const bool repeat = true);
     void killTimer(timerinfo *timer_info);
+    void touchTimer(timerinfo *timer_info);
+    void touchTimers(timerinfo * const *timer_infos, const size_t count);
+    void post(const std::function<void ()> &task);
+    void post(std::function<void ()> &&task);
+    void invoke(const std::function<void ()> &task);
+    void drain(const c_uint32 msec = 0);
+    void clearDnsCache();
 
     const c_int32 execute();
     const c_int32 execute(const EventLoopFlag eventLoopFlag);
     const c_int32 terminate();
 
+    const bool isDraining() const;
+
     static std::string socketAddress(const c_fdptr fd);
+    static std::string localAddress(const c_fdptr fd);
 
     static CEventDispatcher *initialize(const CEventDispatcherConfig &config);
     static CEventDispatcher *instance();
 
     static const c_uint16 socketPort(const c_fdptr fd);
+    static const c_uint16 localPort(const c_fdptr fd);
+
+    static void resumeServers(serverinfo *server_info);
+
+    static void socketConnected(socketinfo *socket_info);
+    static void socketWritten(socketinfo *socket_info);
+    static void socketWriteNotification(bufferevent *buffer_event, void *ctx);
+    static void socketEventNotification(bufferevent *buffer_event, const c_int16 events, void *ctx);
 
 private:
     C_DISABLE_COPY(CEventDispatcher)
@@ -71,8 +111,73 @@ private:
     CEventDispatcher(const CEventDispatcherConfig &config);
     ~CEventDispatcher();
 
+    struct PostTask;
+    struct DnsEntry;
+    struct DnsRequest;
+    struct ConnectRace;
+
+    void initializeBase();
+    void pushPostTask(PostTask *post_task);
+    void registerServer(serverinfo *server_info, evconnlistener *ev_conn_listener);
+    void trackSocket(socketinfo *socket_info);
+    void untrackSocket(socketinfo *socket_info);
+    void finishDrain();
+    void resolveSocket(socketinfo *socket_info, const std::string &address, const c_uint16 port);
+    void connectAddresses(socketinfo *socket_info, const std::vector<sockaddr_storage> &addresses, const c_uint16 port);
+    void startAttempt(ConnectRace *connect_race);
+    void finishRace(ConnectRace *connect_race, const c_fdptr fd);
+    void cancelConnect(socketinfo *socket_info);
+    void cacheAddresses(const std::string &address, const std::vector<sockaddr_storage> &addresses, const c_uint32 ttl);
+
+    bufferevent *socketEvent(socketinfo *socket_info, const c_fdptr fd, const bool accepting);
+
+    const timeval *timerTimeout(const c_uint32 msec);
+
+    static void disconnectSocket(socketinfo *socket_info, bufferevent *buffer_event);
+    static void postNotification(const c_fdptr fd, const c_int16 events, void *ctx);
+    static void timerWheelNotification(const c_fdptr fd, const c_int16 events, void *ctx);
+    static void flushNotification(const c_fdptr fd, const c_int16 events, void *ctx);
+    static void handoffNotification(const c_fdptr fd, const c_int16 events, void *ctx);
+    static void drainNotification(const c_fdptr fd, const c_int16 events, void *ctx);
+    static void rateLimitNotification(evbuffer *buffer, const evbuffer_cb_info *info, void *ctx);
+    static void attemptNotification(const c_fdptr fd, const c_int16 events, void *ctx);
+    static void attemptDelayNotification(const c_fdptr fd, const c_int16 events, void *ctx);
+    static void dnsNotification(const c_int32 result, const char type, const c_int32 count, const c_int32 ttl, void *addresses, void *ctx);
+
     event_base *m_event_base;
     evdns_base *m_evdns_base;
+    evdns_base *m_hosts_base;
+    event *m_post_event;
+    event *m_timer_wheel_event;
+    event *m_flush_event;
+    event *m_drain_event;
+    timerwheel *m_timer_wheel;
+
+    std::atomic<PostTask *> m_post_tasks;
+    std::atomic<std::thread::id> m_thread_id;
+
+    std::unordered_map<c_uint32, timeval> m_timer_timeouts;
+    std::unordered_map<std::string, DnsEntry *> m_dns_cache;
+    std::unordered_map<std::string, DnsRequest *> m_dns_requests;
+    std::unordered_map<socketinfo *, ConnectRace *> m_connect_races;
+
+    std::vector<socketinfo *> m_flush_sockets;
+    std::vector<socketinfo *> m_sockets;
+    std::vector<serverinfo *> m_servers;
+
+    c_uint64 m_timer_wheel_time;
+
+    c_uint32 m_timer_wheel_tick;
+    c_uint32 m_preallocated_infos;
+    c_uint32 m_dns_cache_size;
+    c_uint32 m_dns_cache_ttl;
+    c_uint32 m_dns_negative_ttl;
+    c_uint32 m_connect_attempt_delay;
+
+    bool m_draining;
+
+    friend class CEventDispatcherGroup;
+    friend class CRateLimitGroup;
 };
 
 #endif // CEVENTDISPATCHER_H
@@ -9,10 +9,14 @@ DEPENDPATH     += \
 SOURCES        += \
     ceventdispatcher/ceventdispatcher.cpp \
     ceventdispatcher/ceventdispatcher_config.cpp \
+    ceventdispatcher/ceventdispatcher_group.cpp \
+    ceventdispatcher/ceventdispatcher_ratelimit.cpp \
     ceventdispatcher/ceventdispatcher_types.cpp
 
 HEADERS        += \
     ceventdispatcher/ceventdispatcher.h \
     ceventdispatcher/ceventdispatcher_config.h \
+    ceventdispatcher/ceventdispatcher_group.h \
+    ceventdispatcher/ceventdispatcher_ratelimit.h \
     ceventdispatcher/ceventdispatcher_types.h
 
@@ -27,6 +27,12 @@
 
 CEventDispatcherConfig::CEventDispatcherConfig()
     : m_event_config(nullptr)
+    , m_coarse_timer_tick(CEVENTDISPATCHER_COARSE_TIMER_TICK)
+    , m_preallocated_infos(CEVENTDISPATCHER_PREALLOCATED_INFOS)
+    , m_dns_cache_size(CEVENTDISPATCHER_DNS_CACHE_SIZE)
+    , m_dns_cache_ttl(CEVENTDISPATCHER_DNS_CACHE_TTL)
+    , m_dns_negative_ttl(CEVENTDISPATCHER_DNS_NEGATIVE_TTL)
+    , m_connect_attempt_delay(CEVENTDISPATCHER_CONNECT_ATTEMPT_DELAY)
 {
     m_event_config = event_config_new();
 #if defined(DEBUG)
@@ -109,3 +115,34 @@ const c_int32 CEventDispatcherConfig::avoidMethod(const std::string &method)
     return event_config_avoid_method(m_event_config, method.c_str());
 #endif
 }
+
+const c_int32 CEventDispatcherConfig::setCoarseTimerTick(const c_uint32 msec)
+{
+    if (msec == 0) {
+#if defined(DEBUG)
+        C_DEBUG("invalid coarse timer tick");
+#endif
+        return -1;
+    }
+
+    m_coarse_timer_tick = msec;
+
+    return 0;
+}
+
+void CEventDispatcherConfig::setPreallocatedInfos(const c_uint32 count)
+{
+    m_preallocated_infos = count;
+}
+
+void CEventDispatcherConfig::setConnectAttemptDelay(const c_uint32 msec)
+{
+    m_connect_attempt_delay = msec;
+}
+
+void CEventDispatcherConfig::setDnsCache(const c_uint32 size, const c_uint32 ttl, const c_uint32 negativeTtl)
+{
+    m_dns_cache_size = size;
+    m_dns_cache_ttl = ttl;
+    m_dns_negative_ttl = negativeTtl;
+}
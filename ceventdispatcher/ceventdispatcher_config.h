@@ -34,6 +34,14 @@
 //! Project Includes
 #include "cdefines.h"
 
+//! Defines
+#define CEVENTDISPATCHER_COARSE_TIMER_TICK      10
+#define CEVENTDISPATCHER_PREALLOCATED_INFOS     0
+#define CEVENTDISPATCHER_DNS_CACHE_SIZE         1024
+#define CEVENTDISPATCHER_DNS_CACHE_TTL          60000
+#define CEVENTDISPATCHER_DNS_NEGATIVE_TTL       5000
+#define CEVENTDISPATCHER_CONNECT_ATTEMPT_DELAY  0
+
 class CEventDispatcherConfig
 {
 public:
@@ -57,12 +65,23 @@ public:
     const c_int32 setFeatures(const c_uint16 methodFeatures);
     const c_int32 setFlags(const c_uint16 configFlags);
     const c_int32 avoidMethod(const std::string &method);
+    const c_int32 setCoarseTimerTick(const c_uint32 msec);
+    void setPreallocatedInfos(const c_uint32 count);
+    void setConnectAttemptDelay(const c_uint32 msec);
+    void setDnsCache(const c_uint32 size, const c_uint32 ttl = CEVENTDISPATCHER_DNS_CACHE_TTL, const c_uint32 negativeTtl = CEVENTDISPATCHER_DNS_NEGATIVE_TTL);
 
 private:
     C_DISABLE_COPY(CEventDispatcherConfig)
 
     event_config *m_event_config;
 
+    c_uint32 m_coarse_timer_tick;
+    c_uint32 m_preallocated_infos;
+    c_uint32 m_dns_cache_size;
+    c_uint32 m_dns_cache_ttl;
+    c_uint32 m_dns_negative_ttl;
+    c_uint32 m_connect_attempt_delay;
+
     friend class CEventDispatcher;
 };
 
@@ -0,0 +1,180 @@
+/****************************************************************************
+**
+** Copyright (c) 2013 Calibri-Software <calibrisoftware@gmail.com>
+**
+** Permission is hereby granted, free of charge, to any person obtaining a copy
+** of this software and associated documentation files (the "Software"), to deal
+** in the Software without restriction, including without limitation the rights
+** to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+** copies of the Software, and to permit persons to whom the Software is
+** furnished to do so, subject to the following conditions:
+**
+** The above copyright notice and this permission notice shall be included in
+** all copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+** IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+** FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+** AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+** LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+** OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+** THE SOFTWARE.
+**
+****************************************************************************/
+
+//! Self Includes
+#include "ceventdispatcher_group.h"
+
+//! Platform Includes
+#if defined(_WIN32)
+#   include <windows.h>
+#elif defined(__unix__) || defined(__linux__)
+#   include <pthread.h>
+#endif
+
+static inline const size_t dispatcherCount(const size_t count)
+{
+    if (count != 0)
+        return count;
+
+    const auto concurrency = std::thread::hardware_concurrency();
+
+    return concurrency != 0 ? concurrency : 1;
+}
+
+static inline const bool pinThread(std::thread &thread, const size_t cpu)
+{
+#if defined(_WIN32)
+    return SetThreadAffinityMask(thread.native_handle(), static_cast<DWORD_PTR>(1) << cpu) != 0;
+#elif defined(__linux__)
+    cpu_set_t cpu_set;
+    CPU_ZERO(&cpu_set);
+    CPU_SET(cpu, &cpu_set);
+
+    return pthread_setaffinity_np(thread.native_handle(), sizeof(cpu_set_t), &cpu_set) == 0;
+#else
+    C_UNUSED(thread);
+    C_UNUSED(cpu);
+
+    return false;
+#endif
+}
+
+CEventDispatcherGroup::CEventDispatcherGroup(const size_t count)
+    : m_next(0)
+{
+    const auto size = dispatcherCount(count);
+
+    m_dispatchers.reserve(size);
+
+    for (size_t i = 0; i < size; ++i)
+        m_dispatchers.push_back(new CEventDispatcher());
+}
+
+CEventDispatcherGroup::CEventDispatcherGroup(const CEventDispatcherConfig &config, const size_t count)
+    : m_next(0)
+{
+    const auto size = dispatcherCount(count);
+
+    m_dispatchers.reserve(size);
+
+    for (size_t i = 0; i < size; ++i)
+        m_dispatchers.push_back(new CEventDispatcher(config));
+}
+
+CEventDispatcherGroup::~CEventDispatcherGroup()
+{
+    terminate();
+    wait();
+
+    for (auto *eventDispatcher : m_dispatchers)
+        delete eventDispatcher;
+}
+
+void CEventDispatcherGroup::terminate()
+{
+    if (!isRunning())
+        return;
+
+    // loopexit is queued as an event, so unlike loopbreak it is not lost
+    // when a loop thread has not entered event_base_loop yet
+    for (auto *eventDispatcher : m_dispatchers)
+        event_base_loopexit(eventDispatcher->m_event_base, nullptr);
+}
+
+void CEventDispatcherGroup::drain(const c_uint32 msec)
+{
+    if (!isRunning())
+        return;
+
+    // the socket lists belong to the loop threads
+    for (auto *eventDispatcher : m_dispatchers)
+        eventDispatcher->post([eventDispatcher, msec]() { eventDispatcher->drain(msec); });
+}
+
+void CEventDispatcherGroup::wait()
+{
+    for (auto &thread : m_threads) {
+        if (thread.joinable())
+            thread.join();
+    }
+
+    m_threads.clear();
+
+    for (auto *eventDispatcher : m_dispatchers)
+        eventDispatcher->m_thread_id.store(std::thread::id(), std::memory_order_release);
+}
+
+CEventDispatcher *CEventDispatcherGroup::dispatcher(const size_t index) const
+{
+    if (index >= m_dispatchers.size())
+        return nullptr;
+
+    return m_dispatchers[index];
+}
+
+CEventDispatcher *CEventDispatcherGroup::next()
+{
+    return m_dispatchers[m_next.fetch_add(1, std::memory_order_relaxed) % m_dispatchers.size()];
+}
+
+const size_t CEventDispatcherGroup::count() const
+{
+    return m_dispatchers.size();
+}
+
+const bool CEventDispatcherGroup::start(const bool pinned)
+{
+    if (isRunning())
+        return false;
+
+    const auto concurrency = std::thread::hardware_concurrency();
+
+    m_threads.reserve(m_dispatchers.size());
+
+    for (size_t i = 0; i < m_dispatchers.size(); ++i) {
+        auto *eventDispatcher = m_dispatchers[i];
+
+        m_threads.emplace_back([eventDispatcher]() {
+            infopool_reserve(eventDispatcher->m_preallocated_infos);
+            eventDispatcher->execute(CEventDispatcher::NoExitOnEmpty);
+        });
+
+        // claim the loop before returning, invoke must not run tasks in place
+        // while the thread is still on its way into the loop
+        eventDispatcher->m_thread_id.store(m_threads.back().get_id(), std::memory_order_release);
+
+        if (pinned && concurrency != 0 && !pinThread(m_threads.back(), i % concurrency)) {
+#if defined(DEBUG)
+            C_DEBUG("failed to pin thread");
+#endif
+        }
+    }
+
+    return true;
+}
+
+const bool CEventDispatcherGroup::isRunning() const
+{
+    return !m_threads.empty();
+}
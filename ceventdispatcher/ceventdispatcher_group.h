@@ -0,0 +1,63 @@
+/****************************************************************************
+**
+** Copyright (c) 2013 Calibri-Software <calibrisoftware@gmail.com>
+**
+** Permission is hereby granted, free of charge, to any person obtaining a copy
+** of this software and associated documentation files (the "Software"), to deal
+** in the Software without restriction, including without limitation the rights
+** to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+** copies of the Software, and to permit persons to whom the Software is
+** furnished to do so, subject to the following conditions:
+**
+** The above copyright notice and this permission notice shall be included in
+** all copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+** IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+** FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+** AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+** LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+** OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+** THE SOFTWARE.
+**
+****************************************************************************/
+
+#ifndef CEVENTDISPATCHER_GROUP_H
+#define CEVENTDISPATCHER_GROUP_H
+
+//! Std Includes
+#include <vector>
+#include <thread>
+#include <atomic>
+
+//! CEventDispatcher Includes
+#include "ceventdispatcher.h"
+
+class CEventDispatcherGroup
+{
+public:
+    CEventDispatcherGroup(const size_t count = 0);
+    CEventDispatcherGroup(const CEventDispatcherConfig &config, const size_t count = 0);
+    virtual ~CEventDispatcherGroup();
+
+    void terminate();
+    void drain(const c_uint32 msec = 0);
+    void wait();
+
+    CEventDispatcher *dispatcher(const size_t index) const;
+    CEventDispatcher *next();
+
+    const size_t count() const;
+
+    const bool start(const bool pinned = false);
+    const bool isRunning() const;
+
+private:
+    C_DISABLE_COPY(CEventDispatcherGroup)
+
+    std::vector<CEventDispatcher *> m_dispatchers;
+    std::vector<std::thread> m_threads;
+    std::atomic<size_t> m_next;
+};
+
+#endif // CEVENTDISPATCHER_GROUP_H
@@ -0,0 +1,170 @@
+/****************************************************************************
+**
+** Copyright (c) 2013 Calibri-Software <calibrisoftware@gmail.com>
+**
+** Permission is hereby granted, free of charge, to any person obtaining a copy
+** of this software and associated documentation files (the "Software"), to deal
+** in the Software without restriction, including without limitation the rights
+** to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+** copies of the Software, and to permit persons to whom the Software is
+** furnished to do so, subject to the following conditions:
+**
+** The above copyright notice and this permission notice shall be included in
+** all copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+** IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+** FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+** AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+** LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+** OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+** THE SOFTWARE.
+**
+****************************************************************************/
+
+//! Self Includes
+#include "ceventdispatcher_ratelimit.h"
+
+CRateLimitGroup::CRateLimitGroup(CEventDispatcher *eventDispatcher, const size_t readRate, const size_t readBurst, const size_t writeRate, const size_t writeBurst, const c_uint32 tick)
+    : m_event_dispatcher(eventDispatcher)
+    , m_rate_limit_group(nullptr)
+    , m_read_throttled(0)
+    , m_write_throttled(0)
+{
+    auto *rate_limit = createBucket(readRate, readBurst, writeRate, writeBurst, tick);
+
+    if (!rate_limit)
+        return;
+
+    // the group keeps its own copy of the bucket configuration
+    m_rate_limit_group = bufferevent_rate_limit_group_new(eventDispatcher->m_event_base, rate_limit);
+
+    ev_token_bucket_cfg_free(rate_limit);
+
+#if defined(DEBUG)
+    if (!m_rate_limit_group)
+        C_DEBUG("failed to initialize rate limit group");
+#endif
+}
+
+CRateLimitGroup::~CRateLimitGroup()
+{
+    if (!m_rate_limit_group)
+        return;
+
+    // libevent refuses to free a group with members, and the members belong
+    // to the group's loop, so both happen there
+    m_event_dispatcher->invoke([this]() {
+        for (auto *socket_info : m_event_dispatcher->m_sockets) {
+            if (socketinfo_get_rate_limit_group(socket_info) != this)
+                continue;
+
+            socketinfo_set_rate_limit_group(socket_info, nullptr);
+
+            m_event_dispatcher->setSocketRateLimit(socket_info);
+        }
+
+        bufferevent_rate_limit_group_free(m_rate_limit_group);
+    });
+}
+
+void CRateLimitGroup::resetTotals()
+{
+    if (m_rate_limit_group)
+        bufferevent_rate_limit_group_reset_totals(m_rate_limit_group);
+
+    m_read_throttled.store(0, std::memory_order_relaxed);
+    m_write_throttled.store(0, std::memory_order_relaxed);
+}
+
+CEventDispatcher *CRateLimitGroup::eventDispatcher() const
+{
+    return m_event_dispatcher;
+}
+
+const c_int32 CRateLimitGroup::setRateLimit(const size_t readRate, const size_t readBurst, const size_t writeRate, const size_t writeBurst, const c_uint32 tick)
+{
+    if (!m_rate_limit_group)
+        return -1;
+
+    auto *rate_limit = createBucket(readRate, readBurst, writeRate, writeBurst, tick);
+
+    if (!rate_limit)
+        return -1;
+
+    const auto result = bufferevent_rate_limit_group_set_cfg(m_rate_limit_group, rate_limit);
+
+    ev_token_bucket_cfg_free(rate_limit);
+
+    return result;
+}
+
+const c_int32 CRateLimitGroup::setMinShare(const size_t share)
+{
+    if (!m_rate_limit_group)
+        return -1;
+
+    return bufferevent_rate_limit_group_set_min_share(m_rate_limit_group, share);
+}
+
+const c_uint64 CRateLimitGroup::totalRead() const
+{
+    if (!m_rate_limit_group)
+        return 0;
+
+    ev_uint64_t total_read = 0;
+    bufferevent_rate_limit_group_get_totals(m_rate_limit_group, &total_read, nullptr);
+
+    return total_read;
+}
+
+const c_uint64 CRateLimitGroup::totalWritten() const
+{
+    if (!m_rate_limit_group)
+        return 0;
+
+    ev_uint64_t total_written = 0;
+    bufferevent_rate_limit_group_get_totals(m_rate_limit_group, nullptr, &total_written);
+
+    return total_written;
+}
+
+const c_uint64 CRateLimitGroup::readThrottled() const
+{
+    return m_read_throttled.load(std::memory_order_relaxed);
+}
+
+const c_uint64 CRateLimitGroup::writeThrottled() const
+{
+    return m_write_throttled.load(std::memory_order_relaxed);
+}
+
+const bool CRateLimitGroup::isValid() const
+{
+    return m_rate_limit_group != nullptr;
+}
+
+ev_token_bucket_cfg *CRateLimitGroup::createBucket(const size_t readRate, const size_t readBurst, const size_t writeRate, const size_t writeBurst, const c_uint32 tick)
+{
+    if (tick == 0) {
+#if defined(DEBUG)
+        C_DEBUG("invalid rate limit tick");
+#endif
+        return nullptr;
+    }
+
+    timeval tick_len;
+    tick_len.tv_sec = tick / 1000;
+    tick_len.tv_usec = (tick % 1000) * 1000;
+
+    // a zero rate leaves that direction unlimited
+    auto *rate_limit = ev_token_bucket_cfg_new(readRate != 0 ? readRate : EV_RATE_LIMIT_MAX, readRate != 0 ? readBurst : EV_RATE_LIMIT_MAX,
+                                               writeRate != 0 ? writeRate : EV_RATE_LIMIT_MAX, writeRate != 0 ? writeBurst : EV_RATE_LIMIT_MAX, &tick_len);
+
+#if defined(DEBUG)
+    if (!rate_limit)
+        C_DEBUG("invalid rate limit");
+#endif
+
+    return rate_limit;
+}
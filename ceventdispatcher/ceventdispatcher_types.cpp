@@ -25,29 +25,262 @@
 //! Self Includes
 #include "ceventdispatcher_types.h"
 
+//! Std Includes
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <new>
+#include <utility>
+
+//! LibEvent Includes
+#include <event2/event.h>
+
+//! Defines
+#define TIMERWHEEL_ROOT_BITS    8
+#define TIMERWHEEL_LEVEL_BITS   6
+#define TIMERWHEEL_LEVELS       4
+#define TIMERWHEEL_ROOT_SIZE    (1 << TIMERWHEEL_ROOT_BITS)
+#define TIMERWHEEL_LEVEL_SIZE   (1 << TIMERWHEEL_LEVEL_BITS)
+#define TIMERWHEEL_ROOT_MASK    (TIMERWHEEL_ROOT_SIZE - 1)
+#define TIMERWHEEL_LEVEL_MASK   (TIMERWHEEL_LEVEL_SIZE - 1)
+#define TIMERWHEEL_SLOTS        (TIMERWHEEL_ROOT_SIZE + (TIMERWHEEL_LEVELS - 1) * TIMERWHEEL_LEVEL_SIZE)
+#define TIMERWHEEL_MAX_TICKS    ((static_cast<c_uint64>(1) << (TIMERWHEEL_ROOT_BITS + (TIMERWHEEL_LEVELS - 1) * TIMERWHEEL_LEVEL_BITS)) - 1)
+#define INFOPOOL_MAX_SIZE       4096
+#define HANDOFF_QUEUE_SIZE      1024
+
+/*! infopool */
+// Each loop thread keeps its own free lists, so allocation never takes a
+// lock. A block freed on another thread simply joins that thread's list.
+template<class T>
+struct infopool
+{
+    struct node
+    {
+        node *next;
+    };
+
+    infopool()
+        : head(nullptr)
+        , size(0)
+        , capacity(INFOPOOL_MAX_SIZE)
+    {
+    }
+
+    ~infopool()
+    {
+        while (head) {
+            auto *next = head->next;
+            ::operator delete(head);
+            head = next;
+        }
+
+        size = 0;
+        destroyed() = true;
+    }
+
+    inline void *pop()
+    {
+        if (!head)
+            return ::operator new(sizeof(T) > sizeof(node) ? sizeof(T) : sizeof(node));
+
+        auto *block = head;
+        head = head->next;
+        --size;
+
+        return block;
+    }
+
+    inline void push(void *block)
+    {
+        if (size >= capacity) {
+            ::operator delete(block);
+
+            return;
+        }
+
+        auto *free_node = static_cast<node *>(block);
+        free_node->next = head;
+        head = free_node;
+        ++size;
+    }
+
+    inline void reserve(const size_t count)
+    {
+        if (count > capacity)
+            capacity = count;
+
+        while (size < count)
+            push(::operator new(sizeof(T) > sizeof(node) ? sizeof(T) : sizeof(node)));
+    }
+
+    static inline infopool &local()
+    {
+        static thread_local infopool pool;
+
+        return pool;
+    }
+
+    // trivially destructible, so it stays readable after the pool itself is gone
+    static inline bool &destroyed()
+    {
+        static thread_local bool flag = false;
+
+        return flag;
+    }
+
+    template<class... Args>
+    static inline T *create(Args&&... args)
+    {
+        if (destroyed())
+            return new (::operator new(sizeof(T))) T(std::forward<Args>(args)...);
+
+        return new (local().pop()) T(std::forward<Args>(args)...);
+    }
+
+    static inline void destroy(T *info)
+    {
+        info->~T();
+
+        // infos released by static destructors after thread exit go straight to the heap
+        if (destroyed()) {
+            ::operator delete(info);
+
+            return;
+        }
+
+        local().push(info);
+    }
+
+    node *head;
+    size_t size;
+    size_t capacity;
+};
+
+/*! timerwheelnode */
+struct timerwheelnode
+{
+    timerwheelnode()
+        : prev(this)
+        , next(this)
+        , timer_info(nullptr)
+    {
+    }
+
+    timerwheelnode *prev;
+    timerwheelnode *next;
+    timerinfo *timer_info;
+};
+
+static inline void timerwheelnode_link(timerwheelnode *head, timerwheelnode *node)
+{
+    node->prev = head->prev;
+    node->next = head;
+    head->prev->next = node;
+    head->prev = node;
+}
+
+static inline void timerwheelnode_unlink(timerwheelnode *node)
+{
+    node->prev->next = node->next;
+    node->next->prev = node->prev;
+    node->prev = node;
+    node->next = node;
+}
+
+static inline void timerwheelnode_splice(timerwheelnode *head, timerwheelnode *list)
+{
+    if (list->next == list)
+        return;
+
+    list->next->prev = head->prev;
+    list->prev->next = head;
+    head->prev->next = list->next;
+    head->prev = list->prev;
+    list->prev = list;
+    list->next = list;
+}
+
 /*! timerinfo */
 struct timerinfo
 {
     timerinfo()
         : ev(nullptr)
         , ctx(nullptr)
+        , timer_type(PreciseTimer)
+        , interval(0)
+        , repeat(false)
+        , timer_wheel(nullptr)
+        , wheel_expires(0)
+        , wheel_interval(0)
         , timer_handler(nullptr)
     {
+        wheel_node.timer_info = this;
     }
 
     event *ev;
     void *ctx;
-    std::function<void (timerinfo *)> timer_handler;
+    CTimerType timer_type;
+    c_uint32 interval;
+    bool repeat;
+    timerwheel *timer_wheel;
+    timerwheelnode wheel_node;
+    c_uint64 wheel_expires;
+    c_uint64 wheel_interval;
+    CDelegate<void (timerinfo *)> timer_handler;
 };
 
 timerinfo *timerinfo_new()
 {
-    return new timerinfo();
+    return infopool<timerinfo>::create();
 }
 
 void timerinfo_free(timerinfo *timer_info)
 {
-    delete timer_info;
+    if (timer_info->timer_wheel)
+        timerwheel_remove(timer_info->timer_wheel, timer_info);
+
+    if (timer_info->ev)
+        event_free(timer_info->ev);
+
+    infopool<timerinfo>::destroy(timer_info);
+}
+
+void timerinfo_set_timer_type(timerinfo *timer_info, const CTimerType timer_type)
+{
+    timer_info->timer_type = timer_type;
+}
+
+const CTimerType timerinfo_get_timer_type(const timerinfo *timer_info)
+{
+    return timer_info->timer_type;
+}
+
+void timerinfo_set_interval(timerinfo *timer_info, const c_uint32 interval)
+{
+    timer_info->interval = interval;
+}
+
+const c_uint32 timerinfo_get_interval(const timerinfo *timer_info)
+{
+    return timer_info->interval;
+}
+
+void timerinfo_set_repeat(timerinfo *timer_info, const bool repeat)
+{
+    timer_info->repeat = repeat;
+}
+
+const bool timerinfo_get_repeat(const timerinfo *timer_info)
+{
+    return timer_info->repeat;
+}
+
+const bool timerinfo_is_active(const timerinfo *timer_info)
+{
+    if (timer_info->timer_type == CoarseTimer)
+        return timer_info->timer_wheel != nullptr;
+
+    return timer_info->ev && event_pending(timer_info->ev, EV_TIMEOUT, nullptr) != 0;
 }
 
 void timerinfo_set_event(timerinfo *timer_info, event *ev)
@@ -70,21 +303,186 @@ void *timerinfo_get_context(const timerinfo *timer_info)
     return timer_info->ctx;
 }
 
-void timerinfo_set_timer_handler(timerinfo *timer_info, const std::function<void (timerinfo *)> &handler)
+void timerinfo_set_timer_handler(timerinfo *timer_info, const CDelegate<void (timerinfo *)> &handler)
 {
     timer_info->timer_handler = handler;
 }
 
-void timerinfo_set_timer_handler(timerinfo *timer_info, std::function<void (timerinfo *)> &&handler)
+void timerinfo_set_timer_handler(timerinfo *timer_info, CDelegate<void (timerinfo *)> &&handler)
 {
     timer_info->timer_handler = std::move(handler);
 }
 
-const std::function<void (timerinfo *)> &timerinfo_get_timer_handler(const timerinfo *timer_info)
+const CDelegate<void (timerinfo *)> &timerinfo_get_timer_handler(const timerinfo *timer_info)
 {
     return timer_info->timer_handler;
 }
 
+/*! timerwheel */
+struct timerwheel
+{
+    timerwheel()
+        : now(0)
+        , count(0)
+    {
+    }
+
+    timerwheelnode slots[TIMERWHEEL_SLOTS];
+    c_uint64 now;
+    size_t count;
+};
+
+static inline timerwheelnode *timerwheel_slot(timerwheel *timer_wheel, const c_uint32 level, const c_uint64 index)
+{
+    if (level == 0)
+        return &timer_wheel->slots[index];
+
+    return &timer_wheel->slots[TIMERWHEEL_ROOT_SIZE + (level - 1) * TIMERWHEEL_LEVEL_SIZE + index];
+}
+
+static inline void timerwheel_insert(timerwheel *timer_wheel, timerinfo *timer_info)
+{
+    // timers beyond the wheel range are parked in the last level and
+    // reinserted from timerwheel_advance() until they are really due
+    auto delta = timer_info->wheel_expires > timer_wheel->now ? timer_info->wheel_expires - timer_wheel->now : 0;
+
+    if (delta > TIMERWHEEL_MAX_TICKS)
+        delta = TIMERWHEEL_MAX_TICKS;
+
+    const auto position = timer_wheel->now + delta;
+
+    if (delta < TIMERWHEEL_ROOT_SIZE) {
+        timerwheelnode_link(timerwheel_slot(timer_wheel, 0, position & TIMERWHEEL_ROOT_MASK), &timer_info->wheel_node);
+
+        return;
+    }
+
+    for (c_uint32 level = 1; level < TIMERWHEEL_LEVELS; ++level) {
+        const auto shift = TIMERWHEEL_ROOT_BITS + level * TIMERWHEEL_LEVEL_BITS;
+
+        if (level == TIMERWHEEL_LEVELS - 1 || delta < (static_cast<c_uint64>(1) << shift)) {
+            const auto index = (position >> (shift - TIMERWHEEL_LEVEL_BITS)) & TIMERWHEEL_LEVEL_MASK;
+
+            timerwheelnode_link(timerwheel_slot(timer_wheel, level, index), &timer_info->wheel_node);
+
+            return;
+        }
+    }
+}
+
+static inline const c_uint64 timerwheel_cascade(timerwheel *timer_wheel, const c_uint32 level)
+{
+    const auto index = (timer_wheel->now >> (TIMERWHEEL_ROOT_BITS + (level - 1) * TIMERWHEEL_LEVEL_BITS)) & TIMERWHEEL_LEVEL_MASK;
+
+    timerwheelnode list;
+    timerwheelnode_splice(&list, timerwheel_slot(timer_wheel, level, index));
+
+    while (list.next != &list) {
+        auto *node = list.next;
+        timerwheelnode_unlink(node);
+        timerwheel_insert(timer_wheel, node->timer_info);
+    }
+
+    return index;
+}
+
+timerwheel *timerwheel_new()
+{
+    return new timerwheel();
+}
+
+void timerwheel_free(timerwheel *timer_wheel)
+{
+    for (auto &slot : timer_wheel->slots) {
+        while (slot.next != &slot) {
+            auto *node = slot.next;
+            timerwheelnode_unlink(node);
+            node->timer_info->timer_wheel = nullptr;
+        }
+    }
+
+    delete timer_wheel;
+}
+
+void timerwheel_add(timerwheel *timer_wheel, timerinfo *timer_info, const c_uint64 ticks, const bool repeat)
+{
+    if (timer_info->timer_wheel)
+        timerwheel_remove(timer_info->timer_wheel, timer_info);
+
+    timer_info->timer_wheel = timer_wheel;
+    timer_info->wheel_interval = ticks != 0 ? ticks : 1;
+    timer_info->wheel_expires = timer_wheel->now + timer_info->wheel_interval;
+    timer_info->repeat = repeat;
+
+    timerwheel_insert(timer_wheel, timer_info);
+
+    ++timer_wheel->count;
+}
+
+void timerwheel_remove(timerwheel *timer_wheel, timerinfo *timer_info)
+{
+    if (timer_info->timer_wheel != timer_wheel)
+        return;
+
+    timerwheelnode_unlink(&timer_info->wheel_node);
+
+    timer_info->timer_wheel = nullptr;
+
+    --timer_wheel->count;
+}
+
+void timerwheel_advance(timerwheel *timer_wheel, const c_uint64 ticks)
+{
+    for (c_uint64 i = 0; i < ticks && timer_wheel->count != 0; ++i) {
+        const auto tick = timer_wheel->now;
+        const auto index = tick & TIMERWHEEL_ROOT_MASK;
+
+        if (index == 0) {
+            for (c_uint32 level = 1; level < TIMERWHEEL_LEVELS; ++level) {
+                if (timerwheel_cascade(timer_wheel, level) != 0)
+                    break;
+            }
+        }
+
+        timerwheelnode expired;
+        timerwheelnode_splice(&expired, timerwheel_slot(timer_wheel, 0, index));
+
+        ++timer_wheel->now;
+
+        // handlers may start, kill or free any timer, including the ones
+        // still waiting in the expired list
+        while (expired.next != &expired) {
+            auto *timer_info = expired.next->timer_info;
+            timerwheelnode_unlink(&timer_info->wheel_node);
+
+            if (timer_info->wheel_expires > tick) {
+                timerwheel_insert(timer_wheel, timer_info);
+
+                continue;
+            }
+
+            if (timer_info->repeat) {
+                timer_info->wheel_expires = tick + timer_info->wheel_interval;
+                timerwheel_insert(timer_wheel, timer_info);
+            } else {
+                timer_info->timer_wheel = nullptr;
+
+                --timer_wheel->count;
+            }
+
+            const auto &timer_handler = timer_info->timer_handler;
+
+            if (timer_handler)
+                timer_handler(timer_info);
+        }
+    }
+}
+
+const size_t timerwheel_count(const timerwheel *timer_wheel)
+{
+    return timer_wheel->count;
+}
+
 /*! sslinfo */
 struct sslinfo
 {
@@ -102,18 +500,18 @@ struct sslinfo
     CSSLMode ssl_mode;
     CSSLPeerVerifyMode ssl_peer_verify_mode;
     SSL_CTX *ssl_ctx;
-    std::function<void (socketinfo *)> encrypted_handler;
-    std::function<void (socketinfo *, const c_ulong)> ssl_error_handler;
+    CDelegate<void (socketinfo *)> encrypted_handler;
+    CDelegate<void (socketinfo *, const c_ulong)> ssl_error_handler;
 };
 
 sslinfo *sslinfo_new()
 {
-    return new sslinfo();
+    return infopool<sslinfo>::create();
 }
 
 void sslinfo_free(sslinfo *ssl_info)
 {
-    delete ssl_info;
+    infopool<sslinfo>::destroy(ssl_info);
 }
 
 void sslinfo_set_ssl_protocol(sslinfo *ssl_info, const CSSLProtocol ssl_protocol)
@@ -156,32 +554,32 @@ SSL_CTX *sslinfo_get_ssl_context(const sslinfo *ssl_info)
     return ssl_info->ssl_ctx;
 }
 
-void sslinfo_set_encrypted_handler(sslinfo *ssl_info, const std::function<void (socketinfo *)> &handler)
+void sslinfo_set_encrypted_handler(sslinfo *ssl_info, const CDelegate<void (socketinfo *)> &handler)
 {
     ssl_info->encrypted_handler = handler;
 }
 
-void sslinfo_set_encrypted_handler(sslinfo *ssl_info, std::function<void (socketinfo *)> &&handler)
+void sslinfo_set_encrypted_handler(sslinfo *ssl_info, CDelegate<void (socketinfo *)> &&handler)
 {
     ssl_info->encrypted_handler = std::move(handler);
 }
 
-const std::function<void (socketinfo *)> &sslinfo_get_encrypted_handler(const sslinfo *ssl_info)
+const CDelegate<void (socketinfo *)> &sslinfo_get_encrypted_handler(const sslinfo *ssl_info)
 {
     return ssl_info->encrypted_handler;
 }
 
-void sslinfo_set_ssl_error_handler(sslinfo *ssl_info, const std::function<void (socketinfo *, const c_ulong)> &handler)
+void sslinfo_set_ssl_error_handler(sslinfo *ssl_info, const CDelegate<void (socketinfo *, const c_ulong)> &handler)
 {
     ssl_info->ssl_error_handler = handler;
 }
 
-void sslinfo_set_ssl_error_handler(sslinfo *ssl_info, std::function<void (socketinfo *, const c_ulong)> &&handler)
+void sslinfo_set_ssl_error_handler(sslinfo *ssl_info, CDelegate<void (socketinfo *, const c_ulong)> &&handler)
 {
     ssl_info->ssl_error_handler = std::move(handler);
 }
 
-const std::function<void (socketinfo *, const c_ulong)> &sslinfo_get_ssl_error_handler(const sslinfo *ssl_info)
+const CDelegate<void (socketinfo *, const c_ulong)> &sslinfo_get_ssl_error_handler(const sslinfo *ssl_info)
 {
     return ssl_info->ssl_error_handler;
 }
@@ -193,34 +591,96 @@ struct socketinfo
         : socket_state(Unconnected)
         , buffer_event(nullptr)
         , ctx(nullptr)
+        , event_dispatcher(nullptr)
         , ssl_info(nullptr)
+        , read_timeout(0)
+        , write_timeout(0)
+        , idle_timeout(0)
+        , coalescing(false)
+        , flush_pending(false)
+        , write_full(false)
+        , read_low_watermark(0)
+        , read_high_watermark(0)
+        , write_low_watermark(0)
+        , write_high_watermark(0)
+        , rate_limit(nullptr)
+        , rate_limit_group(nullptr)
+        , read_throttled(0)
+        , write_throttled(0)
+        , index(0)
+        , server_info(nullptr)
+        , admitted(false)
+        , refs(1)
         , connected_handler(nullptr)
         , disconnected_handler(nullptr)
         , read_handler(nullptr)
         , write_handler(nullptr)
         , error_handler(nullptr)
+        , timeout_handler(nullptr)
+        , write_full_handler(nullptr)
+        , write_drained_handler(nullptr)
+    {
+        idle_timer.ctx = this;
+        idle_timer.timer_type = CoarseTimer;
+    }
+
+    ~socketinfo()
     {
+        if (idle_timer.timer_wheel)
+            timerwheel_remove(idle_timer.timer_wheel, &idle_timer);
     }
 
     CSocketState socket_state;
     bufferevent *buffer_event;
     void *ctx;
+    CEventDispatcher *event_dispatcher;
     sslinfo *ssl_info;
-    std::function<void (socketinfo *)> connected_handler;
-    std::function<void (socketinfo *)> disconnected_handler;
-    std::function<void (socketinfo *)> read_handler;
-    std::function<void (socketinfo *)> write_handler;
-    std::function<void (socketinfo *, const c_int32)> error_handler;
+    c_uint32 read_timeout;
+    c_uint32 write_timeout;
+    c_uint32 idle_timeout;
+    bool coalescing;
+    bool flush_pending;
+    bool write_full;
+    size_t read_low_watermark;
+    size_t read_high_watermark;
+    size_t write_low_watermark;
+    size_t write_high_watermark;
+    ev_token_bucket_cfg *rate_limit;
+    CRateLimitGroup *rate_limit_group;
+    c_uint64 read_throttled;
+    c_uint64 write_throttled;
+    size_t index;
+    serverinfo *server_info;
+    bool admitted;
+    std::atomic<c_uint32> refs;
+    timerinfo idle_timer;
+    CDelegate<void (socketinfo *)> connected_handler;
+    CDelegate<void (socketinfo *)> disconnected_handler;
+    CDelegate<void (socketinfo *)> read_handler;
+    CDelegate<void (socketinfo *)> write_handler;
+    CDelegate<void (socketinfo *, const c_int32)> error_handler;
+    CDelegate<void (socketinfo *, const CSocketTimeout)> timeout_handler;
+    CDelegate<void (socketinfo *)> write_full_handler;
+    CDelegate<void (socketinfo *)> write_drained_handler;
 };
 
 socketinfo *socketinfo_new()
 {
-    return new socketinfo();
+    return infopool<socketinfo>::create();
 }
 
+socketinfo *socketinfo_ref(socketinfo *socket_info)
+{
+    socket_info->refs.fetch_add(1, std::memory_order_relaxed);
+
+    return socket_info;
+}
+
+// broadcasts queued for a loop keep the info alive past its socket
 void socketinfo_free(socketinfo *socket_info)
 {
-    delete socket_info;
+    if (socket_info->refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+        infopool<socketinfo>::destroy(socket_info);
 }
 
 void socketinfo_set_socket_state(socketinfo *socket_info, const CSocketState socket_state)
@@ -253,6 +713,16 @@ void *socketinfo_get_context(const socketinfo *socket_info)
     return socket_info->ctx;
 }
 
+void socketinfo_set_event_dispatcher(socketinfo *socket_info, CEventDispatcher *event_dispatcher)
+{
+    socket_info->event_dispatcher = event_dispatcher;
+}
+
+CEventDispatcher *socketinfo_get_event_dispatcher(const socketinfo *socket_info)
+{
+    return socket_info->event_dispatcher;
+}
+
 void socketinfo_set_sslinfo(socketinfo *socket_info, sslinfo *ssl_info)
 {
     socket_info->ssl_info = ssl_info;
@@ -263,106 +733,373 @@ sslinfo *socketinfo_get_sslinfo(const socketinfo *socket_info)
     return socket_info->ssl_info;
 }
 
-void socketinfo_set_connected_handler(socketinfo *socket_info, const std::function<void (socketinfo *)> &handler)
+void socketinfo_set_read_timeout(socketinfo *socket_info, const c_uint32 msec)
+{
+    socket_info->read_timeout = msec;
+}
+
+const c_uint32 socketinfo_get_read_timeout(const socketinfo *socket_info)
+{
+    return socket_info->read_timeout;
+}
+
+void socketinfo_set_write_timeout(socketinfo *socket_info, const c_uint32 msec)
+{
+    socket_info->write_timeout = msec;
+}
+
+const c_uint32 socketinfo_get_write_timeout(const socketinfo *socket_info)
+{
+    return socket_info->write_timeout;
+}
+
+void socketinfo_set_idle_timeout(socketinfo *socket_info, const c_uint32 msec)
+{
+    socket_info->idle_timeout = msec;
+}
+
+const c_uint32 socketinfo_get_idle_timeout(const socketinfo *socket_info)
+{
+    return socket_info->idle_timeout;
+}
+
+timerinfo *socketinfo_get_idle_timer(socketinfo *socket_info)
+{
+    return &socket_info->idle_timer;
+}
+
+void socketinfo_set_coalescing(socketinfo *socket_info, const bool coalescing)
+{
+    socket_info->coalescing = coalescing;
+}
+
+const bool socketinfo_get_coalescing(const socketinfo *socket_info)
+{
+    return socket_info->coalescing;
+}
+
+void socketinfo_set_flush_pending(socketinfo *socket_info, const bool flush_pending)
+{
+    socket_info->flush_pending = flush_pending;
+}
+
+const bool socketinfo_get_flush_pending(const socketinfo *socket_info)
+{
+    return socket_info->flush_pending;
+}
+
+void socketinfo_set_write_full(socketinfo *socket_info, const bool write_full)
+{
+    socket_info->write_full = write_full;
+}
+
+const bool socketinfo_get_write_full(const socketinfo *socket_info)
+{
+    return socket_info->write_full;
+}
+
+void socketinfo_set_read_low_watermark(socketinfo *socket_info, const size_t len)
+{
+    socket_info->read_low_watermark = len;
+}
+
+const size_t socketinfo_get_read_low_watermark(const socketinfo *socket_info)
+{
+    return socket_info->read_low_watermark;
+}
+
+void socketinfo_set_read_high_watermark(socketinfo *socket_info, const size_t len)
+{
+    socket_info->read_high_watermark = len;
+}
+
+const size_t socketinfo_get_read_high_watermark(const socketinfo *socket_info)
+{
+    return socket_info->read_high_watermark;
+}
+
+void socketinfo_set_write_low_watermark(socketinfo *socket_info, const size_t len)
+{
+    socket_info->write_low_watermark = len;
+}
+
+const size_t socketinfo_get_write_low_watermark(const socketinfo *socket_info)
+{
+    return socket_info->write_low_watermark;
+}
+
+void socketinfo_set_write_high_watermark(socketinfo *socket_info, const size_t len)
+{
+    socket_info->write_high_watermark = len;
+}
+
+const size_t socketinfo_get_write_high_watermark(const socketinfo *socket_info)
+{
+    return socket_info->write_high_watermark;
+}
+
+void socketinfo_set_rate_limit(socketinfo *socket_info, ev_token_bucket_cfg *rate_limit)
+{
+    socket_info->rate_limit = rate_limit;
+}
+
+ev_token_bucket_cfg *socketinfo_get_rate_limit(const socketinfo *socket_info)
+{
+    return socket_info->rate_limit;
+}
+
+void socketinfo_set_rate_limit_group(socketinfo *socket_info, CRateLimitGroup *rate_limit_group)
+{
+    socket_info->rate_limit_group = rate_limit_group;
+}
+
+CRateLimitGroup *socketinfo_get_rate_limit_group(const socketinfo *socket_info)
+{
+    return socket_info->rate_limit_group;
+}
+
+void socketinfo_set_read_throttled(socketinfo *socket_info, const c_uint64 count)
+{
+    socket_info->read_throttled = count;
+}
+
+const c_uint64 socketinfo_get_read_throttled(const socketinfo *socket_info)
+{
+    return socket_info->read_throttled;
+}
+
+void socketinfo_set_write_throttled(socketinfo *socket_info, const c_uint64 count)
+{
+    socket_info->write_throttled = count;
+}
+
+const c_uint64 socketinfo_get_write_throttled(const socketinfo *socket_info)
+{
+    return socket_info->write_throttled;
+}
+
+void socketinfo_set_index(socketinfo *socket_info, const size_t index)
+{
+    socket_info->index = index;
+}
+
+const size_t socketinfo_get_index(const socketinfo *socket_info)
+{
+    return socket_info->index;
+}
+
+void socketinfo_set_serverinfo(socketinfo *socket_info, serverinfo *server_info, const bool admitted)
+{
+    socket_info->server_info = server_info;
+    socket_info->admitted = admitted;
+}
+
+serverinfo *socketinfo_get_serverinfo(const socketinfo *socket_info)
+{
+    return socket_info->server_info;
+}
+
+const bool socketinfo_get_admitted(const socketinfo *socket_info)
+{
+    return socket_info->admitted;
+}
+
+void socketinfo_set_connected_handler(socketinfo *socket_info, const CDelegate<void (socketinfo *)> &handler)
 {
     socket_info->connected_handler = handler;
 }
 
-void socketinfo_set_connected_handler(socketinfo *socket_info, std::function<void (socketinfo *)> &&handler)
+void socketinfo_set_connected_handler(socketinfo *socket_info, CDelegate<void (socketinfo *)> &&handler)
 {
     socket_info->connected_handler = std::move(handler);
 }
 
-const std::function<void (socketinfo *)> &socketinfo_get_connected_handler(const socketinfo *socket_info)
+const CDelegate<void (socketinfo *)> &socketinfo_get_connected_handler(const socketinfo *socket_info)
 {
     return socket_info->connected_handler;
 }
 
-void socketinfo_set_disconnected_handler(socketinfo *socket_info, const std::function<void (socketinfo *)> &handler)
+void socketinfo_set_disconnected_handler(socketinfo *socket_info, const CDelegate<void (socketinfo *)> &handler)
 {
     socket_info->disconnected_handler = handler;
 }
 
-void socketinfo_set_disconnected_handler(socketinfo *socket_info, std::function<void (socketinfo *)> &&handler)
+void socketinfo_set_disconnected_handler(socketinfo *socket_info, CDelegate<void (socketinfo *)> &&handler)
 {
     socket_info->disconnected_handler = std::move(handler);
 }
 
-const std::function<void (socketinfo *)> &socketinfo_get_disconnected_handler(const socketinfo *socket_info)
+const CDelegate<void (socketinfo *)> &socketinfo_get_disconnected_handler(const socketinfo *socket_info)
 {
     return socket_info->disconnected_handler;
 }
 
-void socketinfo_set_read_handler(socketinfo *socket_info, const std::function<void (socketinfo *)> &handler)
+void socketinfo_set_read_handler(socketinfo *socket_info, const CDelegate<void (socketinfo *)> &handler)
 {
     socket_info->read_handler = handler;
 }
 
-void socketinfo_set_read_handler(socketinfo *socket_info, std::function<void (socketinfo *)> &&handler)
+void socketinfo_set_read_handler(socketinfo *socket_info, CDelegate<void (socketinfo *)> &&handler)
 {
     socket_info->read_handler = std::move(handler);
 }
 
-const std::function<void (socketinfo *)> &socketinfo_get_read_handler(const socketinfo *socket_info)
+const CDelegate<void (socketinfo *)> &socketinfo_get_read_handler(const socketinfo *socket_info)
 {
     return socket_info->read_handler;
 }
 
-void socketinfo_set_write_handler(socketinfo *socket_info, const std::function<void (socketinfo *)> &handler)
+void socketinfo_set_write_handler(socketinfo *socket_info, const CDelegate<void (socketinfo *)> &handler)
 {
     socket_info->write_handler = handler;
 }
 
-void socketinfo_set_write_handler(socketinfo *socket_info, std::function<void (socketinfo *)> &&handler)
+void socketinfo_set_write_handler(socketinfo *socket_info, CDelegate<void (socketinfo *)> &&handler)
 {
     socket_info->write_handler = std::move(handler);
 }
 
-const std::function<void (socketinfo *)> &socketinfo_get_write_handler(const socketinfo *socket_info)
+const CDelegate<void (socketinfo *)> &socketinfo_get_write_handler(const socketinfo *socket_info)
 {
     return socket_info->write_handler;
 }
 
-void socketinfo_set_error_handler(socketinfo *socket_info, const std::function<void (socketinfo *, const c_int32)> &handler)
+void socketinfo_set_error_handler(socketinfo *socket_info, const CDelegate<void (socketinfo *, const c_int32)> &handler)
 {
     socket_info->error_handler = handler;
 }
 
-void socketinfo_set_error_handler(socketinfo *socket_info, std::function<void (socketinfo *, const c_int32)> &&handler)
+void socketinfo_set_error_handler(socketinfo *socket_info, CDelegate<void (socketinfo *, const c_int32)> &&handler)
 {
     socket_info->error_handler = std::move(handler);
 }
 
-const std::function<void (socketinfo *, const c_int32)> &socketinfo_get_error_handler(const socketinfo *socket_info)
+const CDelegate<void (socketinfo *, const c_int32)> &socketinfo_get_error_handler(const socketinfo *socket_info)
 {
     return socket_info->error_handler;
 }
 
+void socketinfo_set_timeout_handler(socketinfo *socket_info, const CDelegate<void (socketinfo *, const CSocketTimeout)> &handler)
+{
+    socket_info->timeout_handler = handler;
+}
+
+void socketinfo_set_timeout_handler(socketinfo *socket_info, CDelegate<void (socketinfo *, const CSocketTimeout)> &&handler)
+{
+    socket_info->timeout_handler = std::move(handler);
+}
+
+const CDelegate<void (socketinfo *, const CSocketTimeout)> &socketinfo_get_timeout_handler(const socketinfo *socket_info)
+{
+    return socket_info->timeout_handler;
+}
+
+void socketinfo_set_write_full_handler(socketinfo *socket_info, const CDelegate<void (socketinfo *)> &handler)
+{
+    socket_info->write_full_handler = handler;
+}
+
+void socketinfo_set_write_full_handler(socketinfo *socket_info, CDelegate<void (socketinfo *)> &&handler)
+{
+    socket_info->write_full_handler = std::move(handler);
+}
+
+const CDelegate<void (socketinfo *)> &socketinfo_get_write_full_handler(const socketinfo *socket_info)
+{
+    return socket_info->write_full_handler;
+}
+
+void socketinfo_set_write_drained_handler(socketinfo *socket_info, const CDelegate<void (socketinfo *)> &handler)
+{
+    socket_info->write_drained_handler = handler;
+}
+
+void socketinfo_set_write_drained_handler(socketinfo *socket_info, CDelegate<void (socketinfo *)> &&handler)
+{
+    socket_info->write_drained_handler = std::move(handler);
+}
+
+const CDelegate<void (socketinfo *)> &socketinfo_get_write_drained_handler(const socketinfo *socket_info)
+{
+    return socket_info->write_drained_handler;
+}
+
+/*! handoffentry */
+struct handoffentry
+{
+    c_fdptr fd;
+    bool admitted;
+};
+
 /*! serverinfo */
 struct serverinfo
 {
     serverinfo()
         : ev_conn_listener(nullptr)
         , ctx(nullptr)
+        , event_dispatcher(nullptr)
+        , admission(this)
+        , refs(1)
+        , max_connections(0)
+        , connections(0)
+        , rejected(0)
+        , paused(false)
+        , enabled(true)
+        , load(0)
+        , handoff_event(nullptr)
+        , handoff_fds(nullptr)
+        , handoff_head(0)
+        , handoff_tail(0)
+        , handoff_pending(false)
         , accept_handler(nullptr)
         , accept_error_handler(nullptr)
     {
     }
 
+    ~serverinfo()
+    {
+        delete[] handoff_fds;
+    }
+
     evconnlistener *ev_conn_listener;
     void *ctx;
-    std::function<void (serverinfo *, const c_fdptr)> accept_handler;
-    std::function<void (serverinfo *, const c_int32)> accept_error_handler;
+    CEventDispatcher *event_dispatcher;
+    serverinfo *admission;
+    std::atomic<c_uint32> refs;
+    c_uint32 max_connections;
+    std::atomic<c_uint32> connections;
+    std::atomic<c_uint64> rejected;
+    std::atomic<bool> paused;
+    std::atomic<bool> enabled;
+    std::mutex listeners_mutex;
+    std::vector<serverinfo *> listeners;
+    std::atomic<c_uint32> load;
+    event *handoff_event;
+    handoffentry *handoff_fds;
+    std::atomic<size_t> handoff_head;
+    std::atomic<size_t> handoff_tail;
+    std::atomic<bool> handoff_pending;
+    CDelegate<void (serverinfo *, const c_fdptr)> accept_handler;
+    CDelegate<void (serverinfo *, const c_int32)> accept_error_handler;
 };
 
 serverinfo *serverinfo_new()
 {
-    return new serverinfo();
+    return infopool<serverinfo>::create();
 }
 
+serverinfo *serverinfo_ref(serverinfo *server_info)
+{
+    server_info->refs.fetch_add(1, std::memory_order_relaxed);
+
+    return server_info;
+}
+
+// accepted sockets and queued handoffs keep the info alive past its owner
 void serverinfo_free(serverinfo *server_info)
 {
-    delete server_info;
+    if (server_info->refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+        infopool<serverinfo>::destroy(server_info);
 }
 
 void serverinfo_set_evconnlistener(serverinfo *server_info, evconnlistener *ev_conn_listener)
@@ -385,32 +1122,326 @@ void *serverinfo_get_context(const serverinfo *server_info)
     return server_info->ctx;
 }
 
-void serverinfo_set_accept_handler(serverinfo *server_info, const std::function<void (serverinfo *, const c_fdptr)> &handler)
+void serverinfo_set_event_dispatcher(serverinfo *server_info, CEventDispatcher *event_dispatcher)
+{
+    server_info->event_dispatcher = event_dispatcher;
+}
+
+CEventDispatcher *serverinfo_get_event_dispatcher(const serverinfo *server_info)
+{
+    return server_info->event_dispatcher;
+}
+
+void serverinfo_set_accept_handler(serverinfo *server_info, const CDelegate<void (serverinfo *, const c_fdptr)> &handler)
 {
     server_info->accept_handler = handler;
 }
 
-void serverinfo_set_accept_handler(serverinfo *server_info, std::function<void (serverinfo *, const c_fdptr)> &&handler)
+void serverinfo_set_accept_handler(serverinfo *server_info, CDelegate<void (serverinfo *, const c_fdptr)> &&handler)
 {
     server_info->accept_handler = std::move(handler);
 }
 
-const std::function<void (serverinfo *, const c_fdptr)> &serverinfo_get_accept_handler(const serverinfo *server_info)
+const CDelegate<void (serverinfo *, const c_fdptr)> &serverinfo_get_accept_handler(const serverinfo *server_info)
 {
     return server_info->accept_handler;
 }
 
-void serverinfo_set_accept_error_handler(serverinfo *server_info, const std::function<void (serverinfo *, const c_int32)> &handler)
+void serverinfo_set_accept_error_handler(serverinfo *server_info, const CDelegate<void (serverinfo *, const c_int32)> &handler)
 {
     server_info->accept_error_handler = handler;
 }
 
-void serverinfo_set_accept_error_handler(serverinfo *server_info, std::function<void (serverinfo *, const c_int32)> &&handler)
+void serverinfo_set_accept_error_handler(serverinfo *server_info, CDelegate<void (serverinfo *, const c_int32)> &&handler)
 {
     server_info->accept_error_handler = std::move(handler);
 }
 
-const std::function<void (serverinfo *, const c_int32)> &serverinfo_get_accept_error_handler(const serverinfo *server_info)
+const CDelegate<void (serverinfo *, const c_int32)> &serverinfo_get_accept_error_handler(const serverinfo *server_info)
 {
     return server_info->accept_error_handler;
 }
+
+void serverinfo_set_admission(serverinfo *server_info, serverinfo *admission)
+{
+    server_info->admission = admission ? admission : server_info;
+}
+
+serverinfo *serverinfo_get_admission(const serverinfo *server_info)
+{
+    return server_info->admission;
+}
+
+void serverinfo_set_max_connections(serverinfo *server_info, const c_uint32 max_connections)
+{
+    server_info->admission->max_connections = max_connections;
+}
+
+const c_uint32 serverinfo_get_max_connections(const serverinfo *server_info)
+{
+    return server_info->admission->max_connections;
+}
+
+const c_uint32 serverinfo_get_connections(const serverinfo *server_info)
+{
+    return server_info->admission->connections.load(std::memory_order_relaxed);
+}
+
+const c_uint64 serverinfo_get_rejected(const serverinfo *server_info)
+{
+    return server_info->admission->rejected.load(std::memory_order_relaxed);
+}
+
+void serverinfo_set_enabled(serverinfo *server_info, const bool enabled)
+{
+    server_info->admission->enabled.store(enabled, std::memory_order_release);
+}
+
+const bool serverinfo_get_enabled(const serverinfo *server_info)
+{
+    return server_info->admission->enabled.load(std::memory_order_acquire);
+}
+
+const bool serverinfo_get_paused(const serverinfo *server_info)
+{
+    return server_info->admission->paused.load(std::memory_order_acquire);
+}
+
+// every admitted connection holds a reference on the admission info until
+// its slot is released
+const CAdmission serverinfo_acquire_connection(serverinfo *server_info)
+{
+    auto *admission = server_info->admission;
+
+    const auto max_connections = admission->max_connections;
+
+    if (max_connections == 0)
+        return Unlimited;
+
+    const auto connections = admission->connections.fetch_add(1, std::memory_order_acq_rel) + 1;
+
+    if (connections < max_connections) {
+        serverinfo_ref(admission);
+
+        return Admitted;
+    }
+
+    if (connections == max_connections) {
+        serverinfo_ref(admission);
+
+        admission->paused.store(true, std::memory_order_release);
+
+        // a release may have slipped in before the pause became visible
+        bool paused = true;
+
+        if (admission->connections.load(std::memory_order_acquire) < max_connections
+            && admission->paused.compare_exchange_strong(paused, false, std::memory_order_acq_rel))
+            return Admitted;
+
+        return AdmittedLast;
+    }
+
+    admission->connections.fetch_sub(1, std::memory_order_acq_rel);
+    admission->rejected.fetch_add(1, std::memory_order_relaxed);
+
+    return Rejected;
+}
+
+const bool serverinfo_release_connection(serverinfo *server_info)
+{
+    auto *admission = server_info->admission;
+
+    const auto connections = admission->connections.fetch_sub(1, std::memory_order_acq_rel) - 1;
+
+    if (admission->max_connections != 0 && connections >= admission->max_connections)
+        return false;
+
+    // only the release that drops below the limit resumes the listeners
+    bool paused = true;
+
+    return admission->paused.compare_exchange_strong(paused, false, std::memory_order_acq_rel);
+}
+
+const bool serverinfo_resume_connections(serverinfo *server_info)
+{
+    auto *admission = server_info->admission;
+
+    if (admission->max_connections != 0 && admission->connections.load(std::memory_order_acquire) >= admission->max_connections)
+        return false;
+
+    bool paused = true;
+
+    return admission->paused.compare_exchange_strong(paused, false, std::memory_order_acq_rel);
+}
+
+// listeners sharing an admission live on different loops, the list lets a
+// release on any of them find the others
+void serverinfo_add_listener(serverinfo *server_info)
+{
+    auto *admission = server_info->admission;
+
+    std::lock_guard<std::mutex> lock(admission->listeners_mutex);
+
+    admission->listeners.push_back(server_info);
+}
+
+void serverinfo_remove_listener(serverinfo *server_info)
+{
+    auto *admission = server_info->admission;
+
+    std::lock_guard<std::mutex> lock(admission->listeners_mutex);
+
+    admission->listeners.erase(std::remove(admission->listeners.begin(), admission->listeners.end(), server_info), admission->listeners.end());
+}
+
+std::vector<serverinfo *> serverinfo_ref_listeners(serverinfo *server_info)
+{
+    auto *admission = server_info->admission;
+
+    std::lock_guard<std::mutex> lock(admission->listeners_mutex);
+
+    for (auto *listener : admission->listeners)
+        serverinfo_ref(listener);
+
+    return admission->listeners;
+}
+
+void serverinfo_add_load(serverinfo *server_info, const c_int32 delta)
+{
+    server_info->load.fetch_add(static_cast<c_uint32>(delta), std::memory_order_relaxed);
+}
+
+const c_uint32 serverinfo_get_load(const serverinfo *server_info)
+{
+    return server_info->load.load(std::memory_order_relaxed);
+}
+
+void serverinfo_set_handoff_event(serverinfo *server_info, event *ev)
+{
+    server_info->handoff_event = ev;
+
+    if (ev && !server_info->handoff_fds)
+        server_info->handoff_fds = new handoffentry[HANDOFF_QUEUE_SIZE];
+}
+
+event *serverinfo_get_handoff_event(const serverinfo *server_info)
+{
+    return server_info->handoff_event;
+}
+
+// single producer (the accepting loop), single consumer (the worker loop)
+const bool serverinfo_handoff_push(serverinfo *server_info, const c_fdptr fd, const bool admitted)
+{
+    const auto tail = server_info->handoff_tail.load(std::memory_order_relaxed);
+
+    if (tail - server_info->handoff_head.load(std::memory_order_acquire) == HANDOFF_QUEUE_SIZE)
+        return false;
+
+    server_info->handoff_fds[tail % HANDOFF_QUEUE_SIZE] = {fd, admitted};
+    server_info->handoff_tail.store(tail + 1, std::memory_order_release);
+
+    return true;
+}
+
+const bool serverinfo_handoff_pop(serverinfo *server_info, c_fdptr &fd, bool &admitted)
+{
+    const auto head = server_info->handoff_head.load(std::memory_order_relaxed);
+
+    if (head == server_info->handoff_tail.load(std::memory_order_acquire))
+        return false;
+
+    const auto &entry = server_info->handoff_fds[head % HANDOFF_QUEUE_SIZE];
+
+    fd = entry.fd;
+    admitted = entry.admitted;
+    server_info->handoff_head.store(head + 1, std::memory_order_release);
+
+    return true;
+}
+
+const bool serverinfo_set_handoff_pending(serverinfo *server_info, const bool pending)
+{
+    return server_info->handoff_pending.exchange(pending, std::memory_order_acq_rel);
+}
+
+/*! udpinfo */
+struct udpinfo
+{
+    udpinfo()
+        : ev(nullptr)
+        , ctx(nullptr)
+        , event_dispatcher(nullptr)
+        , read_handler(nullptr)
+    {
+    }
+
+    event *ev;
+    void *ctx;
+    CEventDispatcher *event_dispatcher;
+    CDelegate<void (udpinfo *)> read_handler;
+};
+
+udpinfo *udpinfo_new()
+{
+    return infopool<udpinfo>::create();
+}
+
+void udpinfo_free(udpinfo *udp_info)
+{
+    infopool<udpinfo>::destroy(udp_info);
+}
+
+void udpinfo_set_event(udpinfo *udp_info, event *ev)
+{
+    udp_info->ev = ev;
+}
+
+event *udpinfo_get_event(const udpinfo *udp_info)
+{
+    return udp_info->ev;
+}
+
+void udpinfo_set_context(udpinfo *udp_info, void *ctx)
+{
+    udp_info->ctx = ctx;
+}
+
+void *udpinfo_get_context(const udpinfo *udp_info)
+{
+    return udp_info->ctx;
+}
+
+void udpinfo_set_event_dispatcher(udpinfo *udp_info, CEventDispatcher *event_dispatcher)
+{
+    udp_info->event_dispatcher = event_dispatcher;
+}
+
+CEventDispatcher *udpinfo_get_event_dispatcher(const udpinfo *udp_info)
+{
+    return udp_info->event_dispatcher;
+}
+
+void udpinfo_set_read_handler(udpinfo *udp_info, const CDelegate<void (udpinfo *)> &handler)
+{
+    udp_info->read_handler = handler;
+}
+
+void udpinfo_set_read_handler(udpinfo *udp_info, CDelegate<void (udpinfo *)> &&handler)
+{
+    udp_info->read_handler = std::move(handler);
+}
+
+const CDelegate<void (udpinfo *)> &udpinfo_get_read_handler(const udpinfo *udp_info)
+{
+    return udp_info->read_handler;
+}
+
+/*! infopool */
+void infopool_reserve(const size_t count)
+{
+    infopool<timerinfo>::local().reserve(count);
+    infopool<sslinfo>::local().reserve(count);
+    infopool<socketinfo>::local().reserve(count);
+    infopool<serverinfo>::local().reserve(count);
+    infopool<udpinfo>::local().reserve(count);
+}
@@ -0,0 +1,179 @@
+/****************************************************************************
+**
+** Copyright (c) 2013 Calibri-Software <calibrisoftware@gmail.com>
+**
+** Permission is hereby granted, free of charge, to any person obtaining a copy
+** of this software and associated documentation files (the "Software"), to deal
+** in the Software without restriction, including without limitation the rights
+** to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+** copies of the Software, and to permit persons to whom the Software is
+** furnished to do so, subject to the following conditions:
+**
+** The above copyright notice and this permission notice shall be included in
+** all copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+** IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+** FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+** AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+** LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+** OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+** THE SOFTWARE.
+**
+****************************************************************************/
+
+//! Self Includes
+#include "cbroadcast.h"
+
+//! Std Includes
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <unordered_map>
+#include <vector>
+
+//! LibEvent Includes
+#include <event2/bufferevent.h>
+
+/*! Payload */
+// The message is serialized once into a single block; every output buffer
+// holds a reference and the last one to let go frees it.
+struct CBroadcast::Payload
+{
+    std::atomic<c_uint32> refs;
+    size_t len;
+    char data[1];
+};
+
+CBroadcast::CBroadcast(const char *data, const size_t len)
+    : m_payload(nullptr)
+{
+    m_payload = static_cast<Payload *>(malloc(offsetof(Payload, data) + (len != 0 ? len : 1)));
+
+    if (!m_payload) {
+#if defined(DEBUG)
+        C_DEBUG("failed to allocate payload");
+#endif
+        return;
+    }
+
+    new (&m_payload->refs) std::atomic<c_uint32>(1);
+    m_payload->len = len;
+
+    memcpy(m_payload->data, data, len);
+}
+
+CBroadcast::~CBroadcast()
+{
+    if (!m_payload)
+        return;
+
+    releasePayload(m_payload->data, m_payload->len, m_payload);
+}
+
+void CBroadcast::post(CTcpSocket * const *sockets, const size_t count)
+{
+    if (!m_payload)
+        return;
+
+    std::unordered_map<CEventDispatcher *, std::vector<socketinfo *>> batches;
+
+    // the tasks hold the socket infos, not the sockets, so a socket deleted
+    // before its loop runs the task is skipped rather than written to
+    for (size_t i = 0; i < count; ++i)
+        batches[sockets[i]->eventDispatcher()].push_back(socketinfo_ref(sockets[i]->m_socketinfo));
+
+    // one task per loop
+    for (auto &batch : batches) {
+        m_payload->refs.fetch_add(1, std::memory_order_relaxed);
+
+        auto *eventDispatcher = batch.first;
+        auto *payload = m_payload;
+        auto *targets = new std::vector<socketinfo *>(std::move(batch.second));
+
+        eventDispatcher->post([eventDispatcher, payload, targets]() {
+            for (auto *socket_info : *targets) {
+                writePayload(eventDispatcher, socket_info, payload);
+
+                socketinfo_free(socket_info);
+            }
+
+            delete targets;
+
+            releasePayload(payload->data, payload->len, payload);
+        });
+    }
+}
+
+const char *CBroadcast::data() const
+{
+    if (!m_payload)
+        return nullptr;
+
+    return m_payload->data;
+}
+
+const size_t CBroadcast::size() const
+{
+    if (!m_payload)
+        return 0;
+
+    return m_payload->len;
+}
+
+const size_t CBroadcast::send(CTcpSocket * const *sockets, const size_t count)
+{
+    size_t sent = 0;
+
+    for (size_t i = 0; i < count; ++i) {
+        if (send(sockets[i]))
+            ++sent;
+    }
+
+    return sent;
+}
+
+const bool CBroadcast::send(CTcpSocket *socket)
+{
+    if (!m_payload)
+        return false;
+
+    m_payload->refs.fetch_add(1, std::memory_order_relaxed);
+
+    if (!socket->writeReference(m_payload->data, m_payload->len, &CBroadcast::releasePayload, m_payload)) {
+        releasePayload(m_payload->data, m_payload->len, m_payload);
+
+        return false;
+    }
+
+    return true;
+}
+
+void CBroadcast::writePayload(CEventDispatcher *eventDispatcher, socketinfo *socket_info, Payload *payload)
+{
+    // closed, deleted or moved to another loop since the post
+    if (socketinfo_get_socket_state(socket_info) != Connected || socketinfo_get_event_dispatcher(socket_info) != eventDispatcher)
+        return;
+
+    payload->refs.fetch_add(1, std::memory_order_relaxed);
+
+    if (evbuffer_add_reference(bufferevent_get_output(socketinfo_get_bufferevent(socket_info)), payload->data, payload->len, &CBroadcast::releasePayload, payload) != 0) {
+        releasePayload(payload->data, payload->len, payload);
+
+        return;
+    }
+
+    eventDispatcher->checkSocketWatermarks(socket_info);
+}
+
+void CBroadcast::releasePayload(const void *data, size_t len, void *ctx)
+{
+    C_UNUSED(data);
+    C_UNUSED(len);
+
+    auto *payload = static_cast<Payload *>(ctx);
+
+    if (payload->refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+        free(payload);
+}
@@ -0,0 +1,60 @@
+/****************************************************************************
+**
+** Copyright (c) 2013 Calibri-Software <calibrisoftware@gmail.com>
+**
+** Permission is hereby granted, free of charge, to any person obtaining a copy
+** of this software and associated documentation files (the "Software"), to deal
+** in the Software without restriction, including without limitation the rights
+** to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+** copies of the Software, and to permit persons to whom the Software is
+** furnished to do so, subject to the following conditions:
+**
+** The above copyright notice and this permission notice shall be included in
+** all copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+** IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+** FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+** AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+** LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+** OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+** THE SOFTWARE.
+**
+****************************************************************************/
+
+#ifndef CBROADCAST_H
+#define CBROADCAST_H
+
+//! Std Includes
+#include <atomic>
+
+//! CSocket Includes
+#include "ctcpsocket.h"
+
+class CBroadcast
+{
+public:
+    CBroadcast(const char *data, const size_t len);
+    virtual ~CBroadcast();
+
+    void post(CTcpSocket * const *sockets, const size_t count);
+
+    const char *data() const;
+
+    const size_t size() const;
+    const size_t send(CTcpSocket * const *sockets, const size_t count);
+
+    const bool send(CTcpSocket *socket);
+
+private:
+    C_DISABLE_COPY(CBroadcast)
+
+    struct Payload;
+
+    static void releasePayload(const void *data, size_t len, void *ctx);
+    static void writePayload(CEventDispatcher *eventDispatcher, socketinfo *socket_info, Payload *payload);
+
+    Payload *m_payload;
+};
+
+#endif // CBROADCAST_H
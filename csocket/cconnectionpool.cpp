@@ -0,0 +1,428 @@
+/****************************************************************************
+**
+** Copyright (c) 2013 Calibri-Software <calibrisoftware@gmail.com>
+**
+** Permission is hereby granted, free of charge, to any person obtaining a copy
+** of this software and associated documentation files (the "Software"), to deal
+** in the Software without restriction, including without limitation the rights
+** to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+** copies of the Software, and to permit persons to whom the Software is
+** furnished to do so, subject to the following conditions:
+**
+** The above copyright notice and this permission notice shall be included in
+** all copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+** IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+** FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+** AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+** LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+** OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+** THE SOFTWARE.
+**
+****************************************************************************/
+
+//! Self Includes
+#include "cconnectionpool.h"
+
+//! Platform Includes
+#if defined(_WIN32)
+#   include <WinSock2.h>
+#elif defined(__unix__) || defined(__linux__)
+#   include <sys/socket.h>
+#   include <cerrno>
+#endif
+
+//! Std Includes
+#include <algorithm>
+#include <chrono>
+
+//! Bookkeeping for a socket created by the pool
+struct CConnectionPool::Connection
+{
+    Connection(const std::string &key, const CDelegate<void (CTcpSocket *)> &handler)
+        : key(key)
+        , handler(handler)
+        , created(0)
+        , idle_since(0)
+        , idle(false)
+    {
+    }
+
+    std::string key;
+    CDelegate<void (CTcpSocket *)> handler;
+    c_uint64 created;
+    c_uint64 idle_since;
+    bool idle;
+};
+
+static inline const c_uint64 monotonicTime()
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+CConnectionPool::CConnectionPool(CEventDispatcher *eventDispatcher)
+    : m_event_dispatcher(eventDispatcher)
+    , m_sweep_timer(timerinfo_new())
+    , m_socket_factory([](CEventDispatcher *eventDispatcher) { return new CTcpSocket(eventDispatcher); })
+    , m_hits(0)
+    , m_misses(0)
+    , m_idle_count(0)
+    , m_max_idle(CCONNECTIONPOOL_MAX_IDLE)
+    , m_max_idle_time(CCONNECTIONPOOL_MAX_IDLE_TIME)
+    , m_max_age(CCONNECTIONPOOL_MAX_AGE)
+    , m_sweeping(false)
+{
+    timerinfo_set_timer_handler(m_sweep_timer, [this](timerinfo *) { sweep(); });
+}
+
+CConnectionPool::~CConnectionPool()
+{
+    if (m_sweeping)
+        m_event_dispatcher->killTimer(m_sweep_timer);
+
+    timerinfo_free(m_sweep_timer);
+
+    for (auto &connection : m_connections) {
+        resetHandlers(connection.first);
+
+        delete connection.first;
+        delete connection.second;
+    }
+}
+
+void CConnectionPool::setSocketFactory(const std::function<CTcpSocket *(CEventDispatcher *)> &factory)
+{
+    m_socket_factory = factory;
+}
+
+void CConnectionPool::setMaxIdle(const c_uint32 count)
+{
+    m_max_idle = count;
+}
+
+void CConnectionPool::setMaxIdleTime(const c_uint32 msec)
+{
+    m_max_idle_time = msec;
+}
+
+void CConnectionPool::setMaxAge(const c_uint32 msec)
+{
+    m_max_age = msec;
+}
+
+void CConnectionPool::acquire(const std::string &address, const c_uint16 port, const CDelegate<void (CTcpSocket *)> &handler)
+{
+    const auto key = endpoint(address, port);
+
+    auto it = m_idle_sockets.find(key);
+
+    if (it != m_idle_sockets.end()) {
+        const auto now = monotonicTime();
+
+        // the most recently parked socket is the least likely to have been
+        // dropped by the peer
+        while (!it->second.empty()) {
+            auto *socket = it->second.back();
+            auto *connection = m_connections[socket];
+
+            if (!isHealthy(socket, connection, now)) {
+                discard(socket);
+                continue;
+            }
+
+            it->second.pop_back();
+            --m_idle_count;
+
+            connection->idle = false;
+
+            resetHandlers(socket);
+
+            socket->bindNotifications();
+
+            ++m_hits;
+
+            // reused sockets are handed out right away
+            handler(socket);
+
+            return;
+        }
+    }
+
+    ++m_misses;
+
+    auto *socket = m_socket_factory(m_event_dispatcher);
+
+    if (!socket) {
+#if defined(DEBUG)
+        C_DEBUG("failed to create socket");
+#endif
+        handler(nullptr);
+        return;
+    }
+
+    m_connections.emplace(socket, new Connection(key, handler));
+
+    socket->connectToHost(address, port);
+
+    // the pool drives the connect through the delegates, statically
+    // dispatched sockets get their own callbacks back once handed out
+    socket->CTcpSocket::bindNotifications();
+
+    socket->setDisconnectedHandler([this, socket](socketinfo *) { failed(socket); });
+    socket->setErrorHandler([this, socket](socketinfo *, const c_int32) { failed(socket); });
+
+    auto *ssl_info = socketinfo_get_sslinfo(socket->m_socketinfo);
+
+    // ssl sockets are ready for the caller once the handshake is done
+    if (ssl_info) {
+        sslinfo_set_encrypted_handler(ssl_info, [this, socket](socketinfo *) { connected(socket); });
+        sslinfo_set_ssl_error_handler(ssl_info, [this, socket](socketinfo *, const c_ulong) { failed(socket); });
+    } else {
+        socket->setConnectedHandler([this, socket](socketinfo *) { connected(socket); });
+    }
+}
+
+void CConnectionPool::release(CTcpSocket *socket, const bool reusable)
+{
+    const auto it = m_connections.find(socket);
+
+    if (it == m_connections.end() || it->second->idle || it->second->handler) {
+#if defined(DEBUG)
+        C_DEBUG("socket is not checked out of this pool");
+#endif
+        return;
+    }
+
+    auto *connection = it->second;
+
+    if (!reusable || !isHealthy(socket, connection, monotonicTime())) {
+        discard(socket);
+        return;
+    }
+
+    park(socket, connection);
+}
+
+void CConnectionPool::clear()
+{
+    std::vector<CTcpSocket *> sockets;
+
+    for (const auto &idle_sockets : m_idle_sockets)
+        sockets.insert(sockets.end(), idle_sockets.second.begin(), idle_sockets.second.end());
+
+    for (auto *socket : sockets)
+        discard(socket);
+}
+
+CEventDispatcher *CConnectionPool::eventDispatcher() const
+{
+    return m_event_dispatcher;
+}
+
+const size_t CConnectionPool::idleCount() const
+{
+    return m_idle_count;
+}
+
+const size_t CConnectionPool::idleCount(const std::string &address, const c_uint16 port) const
+{
+    const auto it = m_idle_sockets.find(endpoint(address, port));
+
+    return it != m_idle_sockets.end() ? it->second.size() : 0;
+}
+
+const size_t CConnectionPool::activeCount() const
+{
+    return m_connections.size() - m_idle_count;
+}
+
+const c_uint32 CConnectionPool::maxIdle() const
+{
+    return m_max_idle;
+}
+
+const c_uint32 CConnectionPool::maxIdleTime() const
+{
+    return m_max_idle_time;
+}
+
+const c_uint32 CConnectionPool::maxAge() const
+{
+    return m_max_age;
+}
+
+const c_uint64 CConnectionPool::hits() const
+{
+    return m_hits;
+}
+
+const c_uint64 CConnectionPool::misses() const
+{
+    return m_misses;
+}
+
+void CConnectionPool::connected(CTcpSocket *socket)
+{
+    auto *connection = m_connections[socket];
+    connection->created = monotonicTime();
+
+    auto handler = std::move(connection->handler);
+    connection->handler = nullptr;
+
+    resetHandlers(socket);
+
+    socket->bindNotifications();
+
+    handler(socket);
+}
+
+void CConnectionPool::failed(CTcpSocket *socket)
+{
+    const auto it = m_connections.find(socket);
+
+    if (it == m_connections.end())
+        return;
+
+    auto handler = std::move(it->second->handler);
+
+    discard(socket);
+
+    // a pending acquire learns that the connect failed
+    if (handler)
+        handler(nullptr);
+}
+
+void CConnectionPool::park(CTcpSocket *socket, Connection *connection)
+{
+    if (m_max_idle == 0) {
+        discard(socket);
+        return;
+    }
+
+    auto &idle_sockets = m_idle_sockets[connection->key];
+
+    while (idle_sockets.size() >= m_max_idle)
+        discard(idle_sockets.front());
+
+    resetHandlers(socket);
+
+    socket->CTcpSocket::bindNotifications();
+
+    // anything arriving on an idle socket leaves it unusable
+    socket->setReadHandler([this, socket](socketinfo *) { discard(socket); });
+    socket->setDisconnectedHandler([this, socket](socketinfo *) { discard(socket); });
+    socket->setErrorHandler([this, socket](socketinfo *, const c_int32) { discard(socket); });
+
+    connection->idle = true;
+    connection->idle_since = monotonicTime();
+
+    idle_sockets.push_back(socket);
+    ++m_idle_count;
+
+    if (!m_sweeping) {
+        m_event_dispatcher->startTimer(m_sweep_timer, CCONNECTIONPOOL_SWEEP_INTERVAL);
+        m_sweeping = true;
+    }
+}
+
+void CConnectionPool::discard(CTcpSocket *socket)
+{
+    const auto it = m_connections.find(socket);
+
+    if (it == m_connections.end())
+        return;
+
+    auto *connection = it->second;
+
+    if (connection->idle) {
+        auto &idle_sockets = m_idle_sockets[connection->key];
+        idle_sockets.erase(std::find(idle_sockets.begin(), idle_sockets.end(), socket));
+
+        --m_idle_count;
+    }
+
+    delete connection;
+    m_connections.erase(it);
+
+    resetHandlers(socket);
+    socket->close(true);
+
+    // the socket may be inside one of its own callbacks
+    m_event_dispatcher->post([socket]() { delete socket; });
+}
+
+void CConnectionPool::sweep()
+{
+    const auto now = monotonicTime();
+
+    std::vector<CTcpSocket *> expired;
+
+    for (const auto &idle_sockets : m_idle_sockets) {
+        for (auto *socket : idle_sockets.second) {
+            if (!isHealthy(socket, m_connections[socket], now))
+                expired.push_back(socket);
+        }
+    }
+
+    for (auto *socket : expired)
+        discard(socket);
+
+    // an idle pool must not keep the loop alive
+    if (m_idle_count == 0) {
+        m_event_dispatcher->killTimer(m_sweep_timer);
+        m_sweeping = false;
+    }
+}
+
+void CConnectionPool::resetHandlers(CTcpSocket *socket)
+{
+    socket->setConnectedHandler(nullptr);
+    socket->setDisconnectedHandler(nullptr);
+    socket->setReadHandler(nullptr);
+    socket->setWriteHandler(nullptr);
+    socket->setErrorHandler(nullptr);
+    socket->setTimeoutHandler(nullptr);
+    socket->setWriteFullHandler(nullptr);
+    socket->setWriteDrainedHandler(nullptr);
+
+    auto *ssl_info = socketinfo_get_sslinfo(socket->m_socketinfo);
+
+    if (ssl_info) {
+        sslinfo_set_encrypted_handler(ssl_info, nullptr);
+        sslinfo_set_ssl_error_handler(ssl_info, nullptr);
+    }
+}
+
+const bool CConnectionPool::isHealthy(CTcpSocket *socket, const Connection *connection, const c_uint64 now) const
+{
+    if (socket->state() != Connected || socket->bytesToRead() != 0)
+        return false;
+
+    if (m_max_age != 0 && now - connection->created >= m_max_age)
+        return false;
+
+    if (connection->idle && m_max_idle_time != 0 && now - connection->idle_since >= m_max_idle_time)
+        return false;
+
+    // catch a peer close the loop has not reported yet, ssl peers may
+    // still send records that carry no application data
+    char byte;
+    const auto len = recv(socket->socketDescriptor(), &byte, 1, MSG_PEEK);
+
+    // nothing pending is the only healthy error, anything else is a dead socket
+    if (len < 0) {
+#if defined(_WIN32)
+        return WSAGetLastError() == WSAEWOULDBLOCK;
+#else
+        return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+#endif
+    }
+
+    return len != 0 && socketinfo_get_sslinfo(socket->m_socketinfo) != nullptr;
+}
+
+std::string CConnectionPool::endpoint(const std::string &address, const c_uint16 port)
+{
+    return address + ':' + std::to_string(port);
+}
@@ -0,0 +1,110 @@
+/****************************************************************************
+**
+** Copyright (c) 2013 Calibri-Software <calibrisoftware@gmail.com>
+**
+** Permission is hereby granted, free of charge, to any person obtaining a copy
+** of this software and associated documentation files (the "Software"), to deal
+** in the Software without restriction, including without limitation the rights
+** to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+** copies of the Software, and to permit persons to whom the Software is
+** furnished to do so, subject to the following conditions:
+**
+** The above copyright notice and this permission notice shall be included in
+** all copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+** IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+** FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+** AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+** LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+** OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+** THE SOFTWARE.
+**
+****************************************************************************/
+
+#ifndef CCONNECTIONPOOL_H
+#define CCONNECTIONPOOL_H
+
+//! Std Includes
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+//! CSocket Includes
+#include "ctcpsocket.h"
+
+//! Defines
+#define CCONNECTIONPOOL_MAX_IDLE            8
+#define CCONNECTIONPOOL_MAX_IDLE_TIME       30000
+#define CCONNECTIONPOOL_MAX_AGE             0
+#define CCONNECTIONPOOL_SWEEP_INTERVAL      1000
+
+//! Keeps idle connected sockets per host:port for reuse on the owning
+//! loop. Sockets belong to the pool: callers get them from acquire and hand
+//! them back with release. While idle, the pool owns the socket handlers,
+//! so a handler calling release must not touch its captures afterwards.
+class CConnectionPool
+{
+public:
+    CConnectionPool(CEventDispatcher *eventDispatcher = CEventDispatcher::instance());
+    virtual ~CConnectionPool();
+
+    void setSocketFactory(const std::function<CTcpSocket *(CEventDispatcher *)> &factory);
+    void setMaxIdle(const c_uint32 count);
+    void setMaxIdleTime(const c_uint32 msec);
+    void setMaxAge(const c_uint32 msec);
+    void acquire(const std::string &address, const c_uint16 port, const CDelegate<void (CTcpSocket *)> &handler);
+    void release(CTcpSocket *socket, const bool reusable = true);
+    void clear();
+
+    CEventDispatcher *eventDispatcher() const;
+
+    const size_t idleCount() const;
+    const size_t idleCount(const std::string &address, const c_uint16 port) const;
+    const size_t activeCount() const;
+
+    const c_uint32 maxIdle() const;
+    const c_uint32 maxIdleTime() const;
+    const c_uint32 maxAge() const;
+
+    const c_uint64 hits() const;
+    const c_uint64 misses() const;
+
+private:
+    C_DISABLE_COPY(CConnectionPool)
+
+    struct Connection;
+
+    void connected(CTcpSocket *socket);
+    void failed(CTcpSocket *socket);
+    void park(CTcpSocket *socket, Connection *connection);
+    void discard(CTcpSocket *socket);
+    void sweep();
+    void resetHandlers(CTcpSocket *socket);
+
+    const bool isHealthy(CTcpSocket *socket, const Connection *connection, const c_uint64 now) const;
+
+    static std::string endpoint(const std::string &address, const c_uint16 port);
+
+    CEventDispatcher *m_event_dispatcher;
+    timerinfo *m_sweep_timer;
+
+    std::function<CTcpSocket *(CEventDispatcher *)> m_socket_factory;
+
+    std::unordered_map<CTcpSocket *, Connection *> m_connections;
+    std::unordered_map<std::string, std::vector<CTcpSocket *>> m_idle_sockets;
+
+    c_uint64 m_hits;
+    c_uint64 m_misses;
+
+    size_t m_idle_count;
+
+    c_uint32 m_max_idle;
+    c_uint32 m_max_idle_time;
+    c_uint32 m_max_age;
+
+    bool m_sweeping;
+};
+
+#endif // CCONNECTIONPOOL_H
@@ -7,10 +7,19 @@ DEPENDPATH     += \
     $$PWD/..
 
 SOURCES        += \
+    csocket/cbroadcast.cpp \
+    csocket/cconnectionpool.cpp \
     csocket/csslsocket.cpp \
-    csocket/ctcpsocket.cpp
+    csocket/ctcpproxy.cpp \
+    csocket/ctcpsocket.cpp \
+    csocket/cudpsocket.cpp
 
 HEADERS        += \
+    csocket/cbroadcast.h \
+    csocket/cconnectionpool.h \
     csocket/csslsocket.h \
-    csocket/ctcpsocket.h
+    csocket/ctcpproxy.h \
+    csocket/ctcpsocket.h \
+    csocket/ctcpsockett.h \
+    csocket/cudpsocket.h
 
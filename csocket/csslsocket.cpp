@@ -28,8 +28,8 @@
 //! LibEvent Includes
 #include <event2/bufferevent_ssl.h>
 
-CSslSocket::CSslSocket()
-    : CTcpSocket()
+CSslSocket::CSslSocket(CEventDispatcher *eventDispatcher)
+    : CTcpSocket(eventDispatcher)
 {
     auto *ssl_info = sslinfo_new();
     sslinfo_set_ssl_context(ssl_info, SSL_CTX_create(sslinfo_get_ssl_protocol(ssl_info), sslinfo_get_ssl_mode(ssl_info), sslinfo_get_ssl_peer_verify_mode(ssl_info)));
@@ -43,22 +43,22 @@ CSslSocket::~CSslSocket()
     sslinfo_free(socketinfo_get_sslinfo(m_socketinfo));
 }
 
-void CSslSocket::setEncryptedHandler(const std::function<void (socketinfo *)> &handler)
+void CSslSocket::setEncryptedHandler(const CDelegate<void (socketinfo *)> &handler)
 {
     sslinfo_set_encrypted_handler(socketinfo_get_sslinfo(m_socketinfo), handler);
 }
 
-void CSslSocket::setEncryptedHandler(std::function<void (socketinfo *)> &&handler)
+void CSslSocket::setEncryptedHandler(CDelegate<void (socketinfo *)> &&handler)
 {
     sslinfo_set_encrypted_handler(socketinfo_get_sslinfo(m_socketinfo), std::move(handler));
 }
 
-void CSslSocket::setSslErrorHandler(const std::function<void (socketinfo *, const c_ulong)> &handler)
+void CSslSocket::setSslErrorHandler(const CDelegate<void (socketinfo *, const c_ulong)> &handler)
 {
     sslinfo_set_ssl_error_handler(socketinfo_get_sslinfo(m_socketinfo), handler);
 }
 
-void CSslSocket::setSslErrorHandler(std::function<void (socketinfo *, const c_ulong)> &&handler)
+void CSslSocket::setSslErrorHandler(CDelegate<void (socketinfo *, const c_ulong)> &&handler)
 {
     sslinfo_set_ssl_error_handler(socketinfo_get_sslinfo(m_socketinfo), std::move(handler));
 }
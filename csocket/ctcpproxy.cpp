@@ -0,0 +1,489 @@
+/****************************************************************************
+**
+** Copyright (c) 2013 Calibri-Software <calibrisoftware@gmail.com>
+**
+** Permission is hereby granted, free of charge, to any person obtaining a copy
+** of this software and associated documentation files (the "Software"), to deal
+** in the Software without restriction, including without limitation the rights
+** to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+** copies of the Software, and to permit persons to whom the Software is
+** furnished to do so, subject to the following conditions:
+**
+** The above copyright notice and this permission notice shall be included in
+** all copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+** IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+** FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+** AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+** LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+** OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+** THE SOFTWARE.
+**
+****************************************************************************/
+
+//! Self Includes
+#include "ctcpproxy.h"
+
+//! Platform Includes
+#if defined(__linux__)
+#   include <cerrno>
+#   include <fcntl.h>
+#   include <unistd.h>
+#endif
+
+//! LibEvent Includes
+#include <event2/bufferevent.h>
+
+//! One forwarding direction, source input goes to sink output
+struct CTcpProxy::Direction
+{
+    Direction(CTcpProxy *proxy, CTcpSocket *source, CTcpSocket *sink)
+        : proxy(proxy)
+        , source(source)
+        , sink(sink)
+        , read_event(nullptr)
+        , write_event(nullptr)
+        , pending(0)
+        , forwarded(0)
+        , paused(false)
+        , eof(false)
+    {
+        pipe_fds[0] = -1;
+        pipe_fds[1] = -1;
+    }
+
+    CTcpProxy *proxy;
+    CTcpSocket *source;
+    CTcpSocket *sink;
+    event *read_event;
+    event *write_event;
+    c_int32 pipe_fds[2];
+    size_t pending;
+    c_uint64 forwarded;
+    bool paused;
+    bool eof;
+};
+
+CTcpProxy::CTcpProxy(CTcpSocket *first, CTcpSocket *second)
+    : m_closed_handler(nullptr)
+    , m_running(false)
+    , m_spliced(false)
+{
+    m_directions[0] = new Direction(this, first, second);
+    m_directions[1] = new Direction(this, second, first);
+}
+
+CTcpProxy::~CTcpProxy()
+{
+    stop();
+
+    delete m_directions[0];
+    delete m_directions[1];
+}
+
+void CTcpProxy::setClosedHandler(const CDelegate<void (CTcpProxy *)> &handler)
+{
+    m_closed_handler = handler;
+}
+
+void CTcpProxy::setClosedHandler(CDelegate<void (CTcpProxy *)> &&handler)
+{
+    m_closed_handler = std::move(handler);
+}
+
+void CTcpProxy::stop()
+{
+    if (!m_running)
+        return;
+
+    m_running = false;
+
+    for (auto *direction : m_directions) {
+        direction->source->setReadHandler(nullptr);
+        direction->source->setDisconnectedHandler(nullptr);
+        direction->source->setErrorHandler(nullptr);
+        direction->sink->setWriteHandler(nullptr);
+
+        if (direction->read_event) {
+            event_free(direction->read_event);
+            direction->read_event = nullptr;
+        }
+
+        if (direction->write_event) {
+            event_free(direction->write_event);
+            direction->write_event = nullptr;
+        }
+
+        auto *source_event = socketinfo_get_bufferevent(direction->source->m_socketinfo);
+        auto *sink_event = socketinfo_get_bufferevent(direction->sink->m_socketinfo);
+
+#if defined(__linux__)
+        if (direction->pipe_fds[0] != -1) {
+            // whatever the pipe still holds is newer than the sink buffer
+            while (sink_event && direction->pending > 0) {
+                const auto len = evbuffer_read(bufferevent_get_output(sink_event), direction->pipe_fds[0], static_cast<c_int32>(direction->pending));
+
+                if (len <= 0)
+                    break;
+
+                direction->pending -= static_cast<size_t>(len);
+                direction->forwarded += static_cast<c_uint64>(len);
+            }
+
+            ::close(direction->pipe_fds[0]);
+            ::close(direction->pipe_fds[1]);
+
+            direction->pipe_fds[0] = -1;
+            direction->pipe_fds[1] = -1;
+        }
+#endif
+
+        if (source_event)
+            bufferevent_enable(source_event, EV_READ);
+
+        direction->pending = 0;
+        direction->paused = false;
+        direction->eof = false;
+    }
+
+    for (auto *direction : m_directions)
+        direction->source->bindNotifications();
+}
+
+CTcpSocket *CTcpProxy::first() const
+{
+    return m_directions[0]->source;
+}
+
+CTcpSocket *CTcpProxy::second() const
+{
+    return m_directions[1]->source;
+}
+
+const c_uint64 CTcpProxy::forwardedFromFirst() const
+{
+    return m_directions[0]->forwarded;
+}
+
+const c_uint64 CTcpProxy::forwardedFromSecond() const
+{
+    return m_directions[1]->forwarded;
+}
+
+const bool CTcpProxy::start()
+{
+    if (m_running || first()->state() != Connected || second()->state() != Connected)
+        return false;
+
+    // both buffers and the splice events are driven from a single loop
+    if (first()->eventDispatcher() != second()->eventDispatcher()) {
+#if defined(DEBUG)
+        C_DEBUG("sockets belong to different event dispatchers");
+#endif
+        return false;
+    }
+
+    // the proxy drives both sockets through their delegates, statically
+    // dispatched ones included
+    for (auto *direction : m_directions)
+        direction->source->CTcpSocket::bindNotifications();
+
+    m_running = true;
+    m_spliced = false;
+
+#if defined(__linux__)
+    // ssl sockets need their bytes in userspace, so only plaintext pairs
+    // can bypass the buffers
+    m_spliced = !socketinfo_get_sslinfo(first()->m_socketinfo) && !socketinfo_get_sslinfo(second()->m_socketinfo);
+
+    for (auto *direction : m_directions) {
+        if (!m_spliced)
+            break;
+
+        if (pipe2(direction->pipe_fds, O_NONBLOCK | O_CLOEXEC) != 0) {
+            direction->pipe_fds[0] = -1;
+            direction->pipe_fds[1] = -1;
+            m_spliced = false;
+
+            break;
+        }
+
+        fcntl(direction->pipe_fds[1], F_SETPIPE_SZ, CTCPPROXY_PIPE_SIZE);
+
+        auto *base = bufferevent_get_base(socketinfo_get_bufferevent(direction->source->m_socketinfo));
+
+        direction->read_event = event_new(base, direction->source->socketDescriptor(), EV_READ | EV_PERSIST, spliceReadNotification, direction);
+        direction->write_event = event_new(base, direction->sink->socketDescriptor(), EV_WRITE | EV_PERSIST, spliceWriteNotification, direction);
+
+        if (!direction->read_event || !direction->write_event)
+            m_spliced = false;
+    }
+
+    if (!m_spliced) {
+        for (auto *direction : m_directions) {
+            if (direction->read_event) {
+                event_free(direction->read_event);
+                direction->read_event = nullptr;
+            }
+
+            if (direction->write_event) {
+                event_free(direction->write_event);
+                direction->write_event = nullptr;
+            }
+
+            if (direction->pipe_fds[0] != -1) {
+                ::close(direction->pipe_fds[0]);
+                ::close(direction->pipe_fds[1]);
+
+                direction->pipe_fds[0] = -1;
+                direction->pipe_fds[1] = -1;
+            }
+        }
+    }
+#endif
+
+    for (auto *direction : m_directions) {
+        if (!m_spliced) {
+            direction->source->setReadHandler([direction](socketinfo *socket_info) {
+                C_UNUSED(socket_info);
+
+                readNotification(direction);
+            });
+        }
+
+        direction->source->setDisconnectedHandler([this](socketinfo *socket_info) {
+            C_UNUSED(socket_info);
+
+            finish(false);
+        });
+
+        direction->source->setErrorHandler([this](socketinfo *socket_info, const c_int32 error) {
+            C_UNUSED(socket_info);
+            C_UNUSED(error);
+
+            finish(true);
+        });
+
+        direction->sink->setWriteHandler([direction](socketinfo *socket_info) {
+            C_UNUSED(socket_info);
+
+            resume(direction);
+        });
+    }
+
+    for (auto *direction : m_directions) {
+        auto *source_event = socketinfo_get_bufferevent(direction->source->m_socketinfo);
+
+        if (m_spliced) {
+            bufferevent_disable(source_event, EV_READ);
+            event_add(direction->read_event, nullptr);
+        }
+
+        // bytes the source buffered before the proxy started go first
+        readNotification(direction);
+    }
+
+    return true;
+}
+
+const bool CTcpProxy::isRunning() const
+{
+    return m_running;
+}
+
+const bool CTcpProxy::isSpliced() const
+{
+    return m_spliced;
+}
+
+void CTcpProxy::finish(const bool force)
+{
+    if (!m_running)
+        return;
+
+    stop();
+
+    first()->close(force);
+    second()->close(force);
+
+    // the handler may delete the proxy
+    if (m_closed_handler) {
+        const auto closed_handler = m_closed_handler;
+        closed_handler(this);
+    }
+}
+
+void CTcpProxy::readNotification(Direction *direction)
+{
+    auto *input = bufferevent_get_input(socketinfo_get_bufferevent(direction->source->m_socketinfo));
+    auto *output = bufferevent_get_output(socketinfo_get_bufferevent(direction->sink->m_socketinfo));
+
+    const auto len = evbuffer_get_length(input);
+
+    if (len == 0)
+        return;
+
+    // moves the chains, the payload is not copied
+    evbuffer_add_buffer(output, input);
+
+    direction->forwarded += len;
+
+    if (direction->proxy->m_spliced || evbuffer_get_length(output) < CTCPPROXY_BUFFER_SIZE)
+        return;
+
+    bufferevent_disable(socketinfo_get_bufferevent(direction->source->m_socketinfo), EV_READ);
+
+    direction->paused = true;
+}
+
+void CTcpProxy::resume(Direction *direction)
+{
+    if (!direction->paused)
+        return;
+
+    if (!direction->proxy->m_spliced) {
+        direction->paused = false;
+
+        bufferevent_enable(socketinfo_get_bufferevent(direction->source->m_socketinfo), EV_READ);
+
+        return;
+    }
+
+    const auto result = flushPipe(direction);
+
+    if (result < 0) {
+        direction->proxy->finish(true);
+
+        return;
+    }
+
+    if (result == 0)
+        return;
+
+    event_del(direction->write_event);
+
+    direction->paused = false;
+
+    if (direction->eof) {
+        direction->proxy->finish(false);
+
+        return;
+    }
+
+    event_add(direction->read_event, nullptr);
+}
+
+void CTcpProxy::touch(CTcpSocket *socket)
+{
+    // spliced bytes never pass through the bufferevent, keep the idle timer
+    // of a busy socket from firing
+    if (socketinfo_get_idle_timeout(socket->m_socketinfo) != 0)
+        socket->eventDispatcher()->touchTimer(socketinfo_get_idle_timer(socket->m_socketinfo));
+}
+
+void CTcpProxy::spliceReadNotification(const c_fdptr fd, const c_int16 events, void *ctx)
+{
+    C_UNUSED(events);
+
+    auto *direction = reinterpret_cast<Direction *>(ctx);
+
+#if defined(__linux__)
+    // bounded so one busy pair does not starve the rest of the loop
+    for (c_int32 i = 0; i < 16; ++i) {
+        const auto len = splice(fd, nullptr, direction->pipe_fds[1], nullptr, CTCPPROXY_PIPE_SIZE, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+
+        if (len < 0) {
+            if (errno == EINTR)
+                continue;
+
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                return;
+
+            direction->proxy->finish(true);
+
+            return;
+        }
+
+        if (len == 0)
+            direction->eof = true;
+        else
+            touch(direction->source);
+
+        direction->pending += static_cast<size_t>(len);
+
+        const auto result = flushPipe(direction);
+
+        if (result < 0) {
+            direction->proxy->finish(true);
+
+            return;
+        }
+
+        if (result == 0) {
+            event_del(direction->read_event);
+
+            direction->paused = true;
+
+            return;
+        }
+
+        if (direction->eof) {
+            direction->proxy->finish(false);
+
+            return;
+        }
+    }
+#else
+    C_UNUSED(fd);
+    C_UNUSED(direction);
+#endif
+}
+
+void CTcpProxy::spliceWriteNotification(const c_fdptr fd, const c_int16 events, void *ctx)
+{
+    C_UNUSED(fd);
+    C_UNUSED(events);
+
+    resume(reinterpret_cast<Direction *>(ctx));
+}
+
+const c_int32 CTcpProxy::flushPipe(Direction *direction)
+{
+#if defined(__linux__)
+    // keep the order with whatever the sink socket still buffers, its
+    // write notification resumes the pipe once that is gone
+    if (evbuffer_get_length(bufferevent_get_output(socketinfo_get_bufferevent(direction->sink->m_socketinfo))) != 0)
+        return 0;
+
+    const auto fd = direction->sink->socketDescriptor();
+
+    while (direction->pending > 0) {
+        const auto len = splice(direction->pipe_fds[0], nullptr, fd, nullptr, direction->pending, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+
+        if (len < 0) {
+            if (errno == EINTR)
+                continue;
+
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                event_add(direction->write_event, nullptr);
+
+                return 0;
+            }
+
+            return -1;
+        }
+
+        direction->pending -= static_cast<size_t>(len);
+        direction->forwarded += static_cast<c_uint64>(len);
+
+        touch(direction->sink);
+    }
+
+    return 1;
+#else
+    C_UNUSED(direction);
+
+    return 1;
+#endif
+}
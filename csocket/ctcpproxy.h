@@ -0,0 +1,82 @@
+/****************************************************************************
+**
+** Copyright (c) 2013 Calibri-Software <calibrisoftware@gmail.com>
+**
+** Permission is hereby granted, free of charge, to any person obtaining a copy
+** of this software and associated documentation files (the "Software"), to deal
+** in the Software without restriction, including without limitation the rights
+** to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+** copies of the Software, and to permit persons to whom the Software is
+** furnished to do so, subject to the following conditions:
+**
+** The above copyright notice and this permission notice shall be included in
+** all copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+** IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+** FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+** AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+** LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+** OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+** THE SOFTWARE.
+**
+****************************************************************************/
+
+#ifndef CTCPPROXY_H
+#define CTCPPROXY_H
+
+//! CSocket Includes
+#include "ctcpsocket.h"
+
+//! Defines
+#define CTCPPROXY_PIPE_SIZE     65536
+#define CTCPPROXY_BUFFER_SIZE   262144
+
+//! Bidirectional pipe between two connected sockets. Plaintext pairs are
+//! spliced through a kernel pipe, anything else moves evbuffer chains.
+//! While running, the proxy owns the read, write, disconnected and error
+//! handlers of both sockets.
+class CTcpProxy
+{
+public:
+    CTcpProxy(CTcpSocket *first, CTcpSocket *second);
+    virtual ~CTcpProxy();
+
+    void setClosedHandler(const CDelegate<void (CTcpProxy *)> &handler);
+    void setClosedHandler(CDelegate<void (CTcpProxy *)> &&handler);
+    void stop();
+
+    CTcpSocket *first() const;
+    CTcpSocket *second() const;
+
+    const c_uint64 forwardedFromFirst() const;
+    const c_uint64 forwardedFromSecond() const;
+
+    const bool start();
+    const bool isRunning() const;
+    const bool isSpliced() const;
+
+private:
+    C_DISABLE_COPY(CTcpProxy)
+
+    struct Direction;
+
+    void finish(const bool force);
+
+    static void readNotification(Direction *direction);
+    static void resume(Direction *direction);
+    static void touch(CTcpSocket *socket);
+    static void spliceReadNotification(const c_fdptr fd, const c_int16 events, void *ctx);
+    static void spliceWriteNotification(const c_fdptr fd, const c_int16 events, void *ctx);
+
+    static const c_int32 flushPipe(Direction *direction);
+
+    Direction *m_directions[2];
+
+    CDelegate<void (CTcpProxy *)> m_closed_handler;
+
+    bool m_running;
+    bool m_spliced;
+};
+
+#endif // CTCPPROXY_H
@@ -26,90 +26,226 @@
 #include "ctcpsocket.h"
 
 //! Platform Includes
-#if defined(__unix__) || defined(__linux__)
+#if defined(_WIN32)
+#   include <fcntl.h>
+#   include <io.h>
+#elif defined(__unix__) || defined(__linux__)
+#   include <fcntl.h>
 #   include <netinet/tcp.h>
+#   include <unistd.h>
 #endif
 
+//! Std Includes
+#include <algorithm>
+
 //! LibEvent Includes
 #include <event2/bufferevent.h>
 
-CTcpSocket::CTcpSocket()
+CTcpSocket::CTcpSocket(CEventDispatcher *eventDispatcher)
     : m_socketinfo(socketinfo_new())
 {
     socketinfo_set_context(m_socketinfo, this);
+    socketinfo_set_event_dispatcher(m_socketinfo, eventDispatcher);
 }
 
 CTcpSocket::~CTcpSocket()
 {
     close(true);
 
+    auto *rate_limit = socketinfo_get_rate_limit(m_socketinfo);
+
+    if (rate_limit)
+        ev_token_bucket_cfg_free(rate_limit);
+
     socketinfo_free(m_socketinfo);
 }
 
-void CTcpSocket::setConnectedHandler(const std::function<void (socketinfo *)> &handler)
+void CTcpSocket::setConnectedHandler(const CDelegate<void (socketinfo *)> &handler)
 {
     socketinfo_set_connected_handler(m_socketinfo, handler);
 }
 
-void CTcpSocket::setConnectedHandler(std::function<void (socketinfo *)> &&handler)
+void CTcpSocket::setConnectedHandler(CDelegate<void (socketinfo *)> &&handler)
 {
     socketinfo_set_connected_handler(m_socketinfo, std::move(handler));
 }
 
-void CTcpSocket::setDisconnectedHandler(const std::function<void (socketinfo *)> &handler)
+void CTcpSocket::setDisconnectedHandler(const CDelegate<void (socketinfo *)> &handler)
 {
     socketinfo_set_disconnected_handler(m_socketinfo, handler);
 }
 
-void CTcpSocket::setDisconnectedHandler(std::function<void (socketinfo *)> &&handler)
+void CTcpSocket::setDisconnectedHandler(CDelegate<void (socketinfo *)> &&handler)
 {
     socketinfo_set_disconnected_handler(m_socketinfo, std::move(handler));
 }
 
-void CTcpSocket::setReadHandler(const std::function<void (socketinfo *)> &handler)
+void CTcpSocket::setReadHandler(const CDelegate<void (socketinfo *)> &handler)
 {
     socketinfo_set_read_handler(m_socketinfo, handler);
 }
 
-void CTcpSocket::setReadHandler(std::function<void (socketinfo *)> &&handler)
+void CTcpSocket::setReadHandler(CDelegate<void (socketinfo *)> &&handler)
 {
     socketinfo_set_read_handler(m_socketinfo, std::move(handler));
 }
 
-void CTcpSocket::setWriteHandler(const std::function<void (socketinfo *)> &handler)
+void CTcpSocket::setWriteHandler(const CDelegate<void (socketinfo *)> &handler)
 {
     socketinfo_set_write_handler(m_socketinfo, handler);
 }
 
-void CTcpSocket::setWriteHandler(std::function<void (socketinfo *)> &&handler)
+void CTcpSocket::setWriteHandler(CDelegate<void (socketinfo *)> &&handler)
 {
     socketinfo_set_write_handler(m_socketinfo, std::move(handler));
 }
 
-void CTcpSocket::setErrorHandler(const std::function<void (socketinfo *, const c_int32)> &handler)
+void CTcpSocket::setErrorHandler(const CDelegate<void (socketinfo *, const c_int32)> &handler)
 {
     socketinfo_set_error_handler(m_socketinfo, handler);
 }
 
-void CTcpSocket::setErrorHandler(std::function<void (socketinfo *, const c_int32)> &&handler)
+void CTcpSocket::setErrorHandler(CDelegate<void (socketinfo *, const c_int32)> &&handler)
 {
     socketinfo_set_error_handler(m_socketinfo, std::move(handler));
 }
 
+void CTcpSocket::setTimeoutHandler(const CDelegate<void (socketinfo *, const CSocketTimeout)> &handler)
+{
+    socketinfo_set_timeout_handler(m_socketinfo, handler);
+}
+
+void CTcpSocket::setTimeoutHandler(CDelegate<void (socketinfo *, const CSocketTimeout)> &&handler)
+{
+    socketinfo_set_timeout_handler(m_socketinfo, std::move(handler));
+}
+
+void CTcpSocket::setWriteFullHandler(const CDelegate<void (socketinfo *)> &handler)
+{
+    socketinfo_set_write_full_handler(m_socketinfo, handler);
+}
+
+void CTcpSocket::setWriteFullHandler(CDelegate<void (socketinfo *)> &&handler)
+{
+    socketinfo_set_write_full_handler(m_socketinfo, std::move(handler));
+}
+
+void CTcpSocket::setWriteDrainedHandler(const CDelegate<void (socketinfo *)> &handler)
+{
+    socketinfo_set_write_drained_handler(m_socketinfo, handler);
+}
+
+void CTcpSocket::setWriteDrainedHandler(CDelegate<void (socketinfo *)> &&handler)
+{
+    socketinfo_set_write_drained_handler(m_socketinfo, std::move(handler));
+}
+
+void CTcpSocket::setReadTimeout(const c_uint32 msec)
+{
+    socketinfo_set_read_timeout(m_socketinfo, msec);
+
+    eventDispatcher()->setSocketTimeouts(m_socketinfo);
+}
+
+void CTcpSocket::setWriteTimeout(const c_uint32 msec)
+{
+    socketinfo_set_write_timeout(m_socketinfo, msec);
+
+    eventDispatcher()->setSocketTimeouts(m_socketinfo);
+}
+
+void CTcpSocket::setIdleTimeout(const c_uint32 msec)
+{
+    socketinfo_set_idle_timeout(m_socketinfo, msec);
+
+    eventDispatcher()->setSocketTimeouts(m_socketinfo);
+}
+
+void CTcpSocket::setCoalescing(const bool enable)
+{
+    socketinfo_set_coalescing(m_socketinfo, enable);
+
+    eventDispatcher()->setSocketCoalescing(m_socketinfo);
+}
+
+void CTcpSocket::setReadWatermark(const size_t low, const size_t high)
+{
+    socketinfo_set_read_low_watermark(m_socketinfo, low);
+    socketinfo_set_read_high_watermark(m_socketinfo, high);
+
+    eventDispatcher()->setSocketWatermarks(m_socketinfo);
+}
+
+void CTcpSocket::setWriteWatermark(const size_t low, const size_t high)
+{
+    socketinfo_set_write_low_watermark(m_socketinfo, low);
+    socketinfo_set_write_high_watermark(m_socketinfo, high);
+
+    eventDispatcher()->setSocketWatermarks(m_socketinfo);
+}
+
+void CTcpSocket::setRateLimitGroup(CRateLimitGroup *rateLimitGroup)
+{
+    socketinfo_set_rate_limit_group(m_socketinfo, rateLimitGroup);
+
+    eventDispatcher()->setSocketRateLimit(m_socketinfo);
+}
+
+void CTcpSocket::flush()
+{
+    if (state() != Connected)
+        return;
+
+    eventDispatcher()->flushSocket(m_socketinfo);
+}
+
 void CTcpSocket::connectToHost(const std::string &address, const c_uint16 port)
 {
     if (state() != Unconnected)
         return;
 
-    CEventDispatcher::instance()->connectSocket(m_socketinfo, address, port);
+    eventDispatcher()->connectSocket(m_socketinfo, address, port);
+
+    bindNotifications();
+}
+
+void CTcpSocket::connectToLocal(const std::string &path)
+{
+    if (state() != Unconnected)
+        return;
+
+    eventDispatcher()->connectLocalSocket(m_socketinfo, path);
+
+    bindNotifications();
 }
 
 void CTcpSocket::close(const bool force)
 {    
-    if (state() != Connected)
+    switch (state()) {
+    case Unconnected:
         return;
 
-    CEventDispatcher::instance()->closeSocket(m_socketinfo, force);
+    case Closing:
+        if (!force)
+            return;
+
+        break;
+
+    default:
+        break;
+    }
+
+    eventDispatcher()->closeSocket(m_socketinfo, force);
+}
+
+CEventDispatcher *CTcpSocket::eventDispatcher() const
+{
+    return socketinfo_get_event_dispatcher(m_socketinfo);
+}
+
+CRateLimitGroup *CTcpSocket::rateLimitGroup() const
+{
+    return socketinfo_get_rate_limit_group(m_socketinfo);
 }
 
 std::string CTcpSocket::address() const
@@ -138,6 +274,26 @@ const size_t CTcpSocket::bytesToWrite() const
     return evbuffer_get_length(bufferevent_get_output(socketinfo_get_bufferevent(m_socketinfo)));
 }
 
+const size_t CTcpSocket::readLowWatermark() const
+{
+    return socketinfo_get_read_low_watermark(m_socketinfo);
+}
+
+const size_t CTcpSocket::readHighWatermark() const
+{
+    return socketinfo_get_read_high_watermark(m_socketinfo);
+}
+
+const size_t CTcpSocket::writeLowWatermark() const
+{
+    return socketinfo_get_write_low_watermark(m_socketinfo);
+}
+
+const size_t CTcpSocket::writeHighWatermark() const
+{
+    return socketinfo_get_write_high_watermark(m_socketinfo);
+}
+
 const size_t CTcpSocket::write(const char *data, const size_t len)
 {
     if (state() != Connected)
@@ -146,9 +302,82 @@ const size_t CTcpSocket::write(const char *data, const size_t len)
     if (bufferevent_write(socketinfo_get_bufferevent(m_socketinfo), data, len) != 0)
         return 0;
 
+    eventDispatcher()->checkSocketWatermarks(m_socketinfo);
+
+    return len;
+}
+
+const size_t CTcpSocket::writev(const evbuffer_iovec *vectors, const c_int32 count)
+{
+    if (state() != Connected)
+        return 0;
+
+    // reserves room for every span up front, so the message lands whole or not at all
+    const auto len = evbuffer_add_iovec(bufferevent_get_output(socketinfo_get_bufferevent(m_socketinfo)), const_cast<evbuffer_iovec *>(vectors), count);
+
+    eventDispatcher()->checkSocketWatermarks(m_socketinfo);
+
     return len;
 }
 
+const bool CTcpSocket::writeReference(const char *data, const size_t len, evbuffer_ref_cleanup_cb release, void *ctx)
+{
+    if (state() != Connected)
+        return false;
+
+    // on failure the caller keeps ownership and release is never called,
+    // on success release runs exactly once, even for an empty payload
+    if (evbuffer_add_reference(bufferevent_get_output(socketinfo_get_bufferevent(m_socketinfo)), data, len, release, ctx) != 0)
+        return false;
+
+    eventDispatcher()->checkSocketWatermarks(m_socketinfo);
+
+    return true;
+}
+
+const size_t CTcpSocket::sendFile(const c_fdptr fd, const c_int64 offset, const c_int64 length, evbuffer_file_segment_cleanup_cb sent, void *ctx)
+{
+    if (state() != Connected)
+        return 0;
+
+    // the descriptor stays owned by the caller and is read lazily, keep it
+    // open until the segment has been sent
+    auto *file_segment = evbuffer_file_segment_new(fd, offset, length, 0);
+
+    if (!file_segment)
+        return 0;
+
+    return sendFileSegment(file_segment, sent, ctx);
+}
+
+const size_t CTcpSocket::sendFile(const std::string &path, const c_int64 offset, const c_int64 length, evbuffer_file_segment_cleanup_cb sent, void *ctx)
+{
+    if (state() != Connected)
+        return 0;
+
+#if defined(_WIN32)
+    const auto fd = _open(path.c_str(), _O_RDONLY | _O_BINARY);
+#elif defined(__unix__) || defined(__linux__)
+    const auto fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+#endif
+
+    if (fd < 0)
+        return 0;
+
+    auto *file_segment = evbuffer_file_segment_new(fd, offset, length, EVBUF_FS_CLOSE_ON_FREE);
+
+    if (!file_segment) {
+#if defined(_WIN32)
+        _close(fd);
+#elif defined(__unix__) || defined(__linux__)
+        ::close(fd);
+#endif
+        return 0;
+    }
+
+    return sendFileSegment(file_segment, sent, ctx);
+}
+
 const size_t CTcpSocket::read(char *data, const size_t len)
 {
     if (state() != Connected)
@@ -157,6 +386,43 @@ const size_t CTcpSocket::read(char *data, const size_t len)
     return bufferevent_read(socketinfo_get_bufferevent(m_socketinfo), data, len);
 }
 
+const size_t CTcpSocket::consume(const size_t len)
+{
+    if (state() != Connected)
+        return 0;
+
+    auto *input = bufferevent_get_input(socketinfo_get_bufferevent(m_socketinfo));
+
+    const auto length = std::min(len, evbuffer_get_length(input));
+
+    if (evbuffer_drain(input, length) != 0)
+        return 0;
+
+    return length;
+}
+
+const c_int32 CTcpSocket::peek(evbuffer_iovec *vectors, const c_int32 count, const size_t len) const
+{
+    if (state() != Connected)
+        return 0;
+
+    // a length of -1 asks libevent for the whole input buffer
+    return evbuffer_peek(bufferevent_get_input(socketinfo_get_bufferevent(m_socketinfo)), static_cast<ev_ssize_t>(len), nullptr, vectors, count);
+}
+
+const char *CTcpSocket::pullup(const size_t len)
+{
+    if (state() != Connected)
+        return nullptr;
+
+    auto *input = bufferevent_get_input(socketinfo_get_bufferevent(m_socketinfo));
+
+    if (len > evbuffer_get_length(input))
+        return nullptr;
+
+    return reinterpret_cast<const char *>(evbuffer_pullup(input, static_cast<ev_ssize_t>(len)));
+}
+
 const c_fdptr CTcpSocket::socketDescriptor() const
 {
     if (state() != Connected)
@@ -175,26 +441,98 @@ const c_int32 CTcpSocket::error() const
     return evutil_socket_geterror(fd);
 }
 
+const c_int32 CTcpSocket::setRateLimit(const size_t readRate, const size_t readBurst, const size_t writeRate, const size_t writeBurst, const c_uint32 tick)
+{
+    ev_token_bucket_cfg *rate_limit = nullptr;
+
+    if (readRate != 0 || writeRate != 0) {
+        rate_limit = CRateLimitGroup::createBucket(readRate, readBurst, writeRate, writeBurst, tick);
+
+        if (!rate_limit)
+            return -1;
+    }
+
+    // the bufferevent only references the bucket, free the old one after
+    // the new one is in place
+    auto *old_rate_limit = socketinfo_get_rate_limit(m_socketinfo);
+
+    socketinfo_set_rate_limit(m_socketinfo, rate_limit);
+
+    eventDispatcher()->setSocketRateLimit(m_socketinfo);
+
+    if (old_rate_limit)
+        ev_token_bucket_cfg_free(old_rate_limit);
+
+    return 0;
+}
+
 const c_uint16 CTcpSocket::port() const
 {
     return CEventDispatcher::socketPort(socketDescriptor());
 }
 
+const c_uint32 CTcpSocket::readTimeout() const
+{
+    return socketinfo_get_read_timeout(m_socketinfo);
+}
+
+const c_uint32 CTcpSocket::writeTimeout() const
+{
+    return socketinfo_get_write_timeout(m_socketinfo);
+}
+
+const c_uint32 CTcpSocket::idleTimeout() const
+{
+    return socketinfo_get_idle_timeout(m_socketinfo);
+}
+
+const c_uint64 CTcpSocket::readThrottled() const
+{
+    return socketinfo_get_read_throttled(m_socketinfo);
+}
+
+const c_uint64 CTcpSocket::writeThrottled() const
+{
+    return socketinfo_get_write_throttled(m_socketinfo);
+}
+
 const CSocketState CTcpSocket::state() const
 {
     return socketinfo_get_socket_state(m_socketinfo);
 }
 
+const bool CTcpSocket::coalescing() const
+{
+    return socketinfo_get_coalescing(m_socketinfo);
+}
+
+const bool CTcpSocket::isWriteFull() const
+{
+    return socketinfo_get_write_full(m_socketinfo);
+}
+
+const bool CTcpSocket::setEventDispatcher(CEventDispatcher *eventDispatcher)
+{
+    if (state() != Unconnected || !eventDispatcher)
+        return false;
+
+    socketinfo_set_event_dispatcher(m_socketinfo, eventDispatcher);
+
+    return true;
+}
+
 const bool CTcpSocket::setSocketDescriptor(const c_fdptr fd)
 {
     if (state() != Unconnected)
         return false;
 
-    CEventDispatcher::instance()->acceptSocket(m_socketinfo, fd);
+    eventDispatcher()->acceptSocket(m_socketinfo, fd);
 
     if (state() != Connected)
         return false;
 
+    bindNotifications();
+
     return true;
 }
 
@@ -245,3 +583,33 @@ const bool CTcpSocket::setKeepAlive(const c_uint32 flag, const c_uint32 idle, co
     return true;
 #endif
 }
+
+void CTcpSocket::bindNotifications()
+{
+    eventDispatcher()->setSocketNotifications(m_socketinfo);
+}
+
+const size_t CTcpSocket::sendFileSegment(evbuffer_file_segment *file_segment, evbuffer_file_segment_cleanup_cb sent, void *ctx)
+{
+    auto *output = bufferevent_get_output(socketinfo_get_bufferevent(m_socketinfo));
+
+    const auto len = evbuffer_get_length(output);
+
+    // plain sockets hand the segment to sendfile, ssl ones map or read it
+    if (evbuffer_add_file_segment(output, file_segment, 0, -1) != 0) {
+        evbuffer_file_segment_free(file_segment);
+
+        return 0;
+    }
+
+    // registered only now, so a failed send never calls it; it runs once
+    // the output buffer dropped its last reference to the segment
+    if (sent)
+        evbuffer_file_segment_add_cleanup_cb(file_segment, sent, ctx);
+
+    evbuffer_file_segment_free(file_segment);
+
+    eventDispatcher()->checkSocketWatermarks(m_socketinfo);
+
+    return evbuffer_get_length(output) - len;
+}
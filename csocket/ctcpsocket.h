@@ -27,51 +27,103 @@
 
 //! CEventDispatcher Includes
 #include "ceventdispatcher.h"
+#include "ceventdispatcher_ratelimit.h"
 
 class CTcpSocket
 {
 public:
-    CTcpSocket();
+    CTcpSocket(CEventDispatcher *eventDispatcher = CEventDispatcher::instance());
     virtual ~CTcpSocket();
 
-    void setConnectedHandler(const std::function<void (socketinfo *)> &handler);
-    void setConnectedHandler(std::function<void (socketinfo *)> &&handler);
-    void setDisconnectedHandler(const std::function<void (socketinfo *)> &handler);
-    void setDisconnectedHandler(std::function<void (socketinfo *)> &&handler);
-    void setReadHandler(const std::function<void (socketinfo *)> &handler);
-    void setReadHandler(std::function<void (socketinfo *)> &&handler);
-    void setWriteHandler(const std::function<void (socketinfo *)> &handler);
-    void setWriteHandler(std::function<void (socketinfo *)> &&handler);
-    void setErrorHandler(const std::function<void (socketinfo *, const c_int32)> &handler);
-    void setErrorHandler(std::function<void (socketinfo *, const c_int32)> &&handler);
+    void setConnectedHandler(const CDelegate<void (socketinfo *)> &handler);
+    void setConnectedHandler(CDelegate<void (socketinfo *)> &&handler);
+    void setDisconnectedHandler(const CDelegate<void (socketinfo *)> &handler);
+    void setDisconnectedHandler(CDelegate<void (socketinfo *)> &&handler);
+    void setReadHandler(const CDelegate<void (socketinfo *)> &handler);
+    void setReadHandler(CDelegate<void (socketinfo *)> &&handler);
+    void setWriteHandler(const CDelegate<void (socketinfo *)> &handler);
+    void setWriteHandler(CDelegate<void (socketinfo *)> &&handler);
+    void setErrorHandler(const CDelegate<void (socketinfo *, const c_int32)> &handler);
+    void setErrorHandler(CDelegate<void (socketinfo *, const c_int32)> &&handler);
+    void setTimeoutHandler(const CDelegate<void (socketinfo *, const CSocketTimeout)> &handler);
+    void setTimeoutHandler(CDelegate<void (socketinfo *, const CSocketTimeout)> &&handler);
+    void setWriteFullHandler(const CDelegate<void (socketinfo *)> &handler);
+    void setWriteFullHandler(CDelegate<void (socketinfo *)> &&handler);
+    void setWriteDrainedHandler(const CDelegate<void (socketinfo *)> &handler);
+    void setWriteDrainedHandler(CDelegate<void (socketinfo *)> &&handler);
+    void setReadTimeout(const c_uint32 msec);
+    void setWriteTimeout(const c_uint32 msec);
+    void setIdleTimeout(const c_uint32 msec);
+    void setCoalescing(const bool enable);
+    void setReadWatermark(const size_t low, const size_t high = 0);
+    void setWriteWatermark(const size_t low, const size_t high = 0);
+    void setRateLimitGroup(CRateLimitGroup *rateLimitGroup);
+    void flush();
     void connectToHost(const std::string &address, const c_uint16 port);
+    void connectToLocal(const std::string &path);
     void close(const bool force = false);
 
+    CEventDispatcher *eventDispatcher() const;
+    CRateLimitGroup *rateLimitGroup() const;
+
     std::string address() const;
     std::string errorString() const;
 
     const size_t bytesToRead() const;
     const size_t bytesToWrite() const;
+    const size_t readLowWatermark() const;
+    const size_t readHighWatermark() const;
+    const size_t writeLowWatermark() const;
+    const size_t writeHighWatermark() const;
     const size_t write(const char *data, const size_t len);
+    const size_t writev(const evbuffer_iovec *vectors, const c_int32 count);
+    const size_t sendFile(const c_fdptr fd, const c_int64 offset = 0, const c_int64 length = -1, evbuffer_file_segment_cleanup_cb sent = nullptr, void *ctx = nullptr);
+    const size_t sendFile(const std::string &path, const c_int64 offset = 0, const c_int64 length = -1, evbuffer_file_segment_cleanup_cb sent = nullptr, void *ctx = nullptr);
     const size_t read(char *data, const size_t len);
+    const size_t consume(const size_t len);
+
+    const c_int32 peek(evbuffer_iovec *vectors, const c_int32 count, const size_t len = static_cast<size_t>(-1)) const;
+
+    const char *pullup(const size_t len);
 
     const c_fdptr socketDescriptor() const;
 
     const c_int32 error() const;
+    const c_int32 setRateLimit(const size_t readRate, const size_t readBurst, const size_t writeRate, const size_t writeBurst, const c_uint32 tick = CRATELIMIT_TICK);
 
     const c_uint16 port() const;
 
+    const c_uint32 readTimeout() const;
+    const c_uint32 writeTimeout() const;
+    const c_uint32 idleTimeout() const;
+
+    const c_uint64 readThrottled() const;
+    const c_uint64 writeThrottled() const;
+
     const CSocketState state() const;
 
+    const bool coalescing() const;
+    const bool isWriteFull() const;
+    const bool writeReference(const char *data, const size_t len, evbuffer_ref_cleanup_cb release, void *ctx = nullptr);
+
+    const bool setEventDispatcher(CEventDispatcher *eventDispatcher);
     const bool setSocketDescriptor(const c_fdptr fd);
     const bool setNoDelay(const c_uint32 flag);
     const bool setKeepAlive(const c_uint32 flag, const c_uint32 idle = 0, const c_uint32 interval = 0, const c_uint32 count = 0);
 
 protected:
+    virtual void bindNotifications();
+
     socketinfo *m_socketinfo;
 
 private:    
     C_DISABLE_COPY(CTcpSocket)
+
+    const size_t sendFileSegment(evbuffer_file_segment *file_segment, evbuffer_file_segment_cleanup_cb sent, void *ctx);
+
+    friend class CBroadcast;
+    friend class CConnectionPool;
+    friend class CTcpProxy;
 };
 
 #endif // CTCPSOCKET_H
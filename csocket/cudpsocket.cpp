@@ -0,0 +1,358 @@
+/****************************************************************************
+**
+** Copyright (c) 2013 Calibri-Software <calibrisoftware@gmail.com>
+**
+** Permission is hereby granted, free of charge, to any person obtaining a copy
+** of this software and associated documentation files (the "Software"), to deal
+** in the Software without restriction, including without limitation the rights
+** to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+** copies of the Software, and to permit persons to whom the Software is
+** furnished to do so, subject to the following conditions:
+**
+** The above copyright notice and this permission notice shall be included in
+** all copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+** IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+** FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+** AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+** LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+** OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+** THE SOFTWARE.
+**
+****************************************************************************/
+
+//! Self Includes
+#include "cudpsocket.h"
+
+//! Platform Includes
+#if defined(_WIN32)
+#   include <WS2tcpip.h>
+#elif defined(__unix__) || defined(__linux__)
+#   include <cstring>
+#   include <netinet/in.h>
+#   include <sys/uio.h>
+#endif
+
+//! Std Includes
+#include <algorithm>
+#include <vector>
+
+//! Receive buffers are allocated once per socket, every slot holds one
+//! datagram and its sender address
+struct CUdpSocket::Batch
+{
+    Batch(const size_t batchSize, const size_t datagramSize)
+        : batch_size(std::max<size_t>(batchSize, 1))
+        , datagram_size(std::max<size_t>(datagramSize, 1))
+        , buffer(batch_size * datagram_size)
+        , addresses(batch_size)
+#if defined(__linux__)
+        , iovecs(batch_size)
+        , messages(batch_size)
+#endif
+    {
+    }
+
+    size_t batch_size;
+    size_t datagram_size;
+    std::vector<char> buffer;
+    std::vector<sockaddr_storage> addresses;
+#if defined(__linux__)
+    std::vector<iovec> iovecs;
+    std::vector<mmsghdr> messages;
+#endif
+};
+
+CUdpSocket::CUdpSocket(CEventDispatcher *eventDispatcher, const size_t batchSize, const size_t datagramSize)
+    : m_udpinfo(udpinfo_new())
+    , m_batch(new Batch(batchSize, datagramSize))
+{
+    udpinfo_set_context(m_udpinfo, this);
+    udpinfo_set_event_dispatcher(m_udpinfo, eventDispatcher);
+}
+
+CUdpSocket::~CUdpSocket()
+{
+    close();
+
+    udpinfo_free(m_udpinfo);
+
+    delete m_batch;
+}
+
+void CUdpSocket::setReadHandler(const CDelegate<void (udpinfo *)> &handler)
+{
+    udpinfo_set_read_handler(m_udpinfo, handler);
+}
+
+void CUdpSocket::setReadHandler(CDelegate<void (udpinfo *)> &&handler)
+{
+    udpinfo_set_read_handler(m_udpinfo, std::move(handler));
+}
+
+CEventDispatcher *CUdpSocket::eventDispatcher() const
+{
+    return udpinfo_get_event_dispatcher(m_udpinfo);
+}
+
+std::string CUdpSocket::address() const
+{
+    return CEventDispatcher::localAddress(socketDescriptor());
+}
+
+std::string CUdpSocket::errorString() const
+{
+    return evutil_socket_error_to_string(error());
+}
+
+const size_t CUdpSocket::readDatagrams(CDatagram *datagrams, const size_t count)
+{
+    if (!isBound() || count == 0)
+        return 0;
+
+    const auto fd = socketDescriptor();
+    const auto batch_size = std::min(count, m_batch->batch_size);
+
+#if defined(__linux__)
+    // recvmmsg overwrites the name lengths, so the headers are reset on
+    // every call while the buffers themselves stay in place
+    for (size_t i = 0; i < batch_size; ++i) {
+        m_batch->iovecs[i].iov_base = m_batch->buffer.data() + i * m_batch->datagram_size;
+        m_batch->iovecs[i].iov_len = m_batch->datagram_size;
+
+        auto &msg_hdr = m_batch->messages[i].msg_hdr;
+        memset(&msg_hdr, 0, sizeof(msghdr));
+        msg_hdr.msg_name = &m_batch->addresses[i];
+        msg_hdr.msg_namelen = sizeof(sockaddr_storage);
+        msg_hdr.msg_iov = &m_batch->iovecs[i];
+        msg_hdr.msg_iovlen = 1;
+    }
+
+    const auto result = recvmmsg(fd, m_batch->messages.data(), static_cast<c_uint32>(batch_size), 0, nullptr);
+
+    if (result <= 0)
+        return 0;
+
+    const auto received = static_cast<size_t>(result);
+
+    for (size_t i = 0; i < received; ++i) {
+        const auto &message = m_batch->messages[i];
+
+        datagrams[i].data = m_batch->buffer.data() + i * m_batch->datagram_size;
+        datagrams[i].size = message.msg_len;
+        datagrams[i].address = m_batch->addresses[i];
+        datagrams[i].address_length = message.msg_hdr.msg_namelen;
+        datagrams[i].truncated = (message.msg_hdr.msg_flags & MSG_TRUNC) != 0;
+    }
+
+    return received;
+#else
+    size_t received = 0;
+
+    for (; received < batch_size; ++received) {
+        auto *data = m_batch->buffer.data() + received * m_batch->datagram_size;
+        auto address_length = static_cast<socklen_t>(sizeof(sockaddr_storage));
+
+        const auto result = recvfrom(fd, data, static_cast<c_int32>(m_batch->datagram_size), 0, reinterpret_cast<sockaddr *>(&m_batch->addresses[received]), &address_length);
+
+        if (result < 0)
+            break;
+
+        datagrams[received].data = data;
+        datagrams[received].size = static_cast<size_t>(result);
+        datagrams[received].address = m_batch->addresses[received];
+        datagrams[received].address_length = static_cast<c_uint32>(address_length);
+        datagrams[received].truncated = false;
+    }
+
+    return received;
+#endif
+}
+
+const size_t CUdpSocket::writeDatagrams(const CDatagram *datagrams, const size_t count)
+{
+    if (!isBound())
+        return 0;
+
+    const auto fd = socketDescriptor();
+
+    size_t sent = 0;
+
+#if defined(__linux__)
+    while (sent < count) {
+        const auto batch_size = std::min(count - sent, m_batch->batch_size);
+
+        for (size_t i = 0; i < batch_size; ++i) {
+            const auto &datagram = datagrams[sent + i];
+
+            // the send path only borrows the receive headers, not the buffers
+            m_batch->iovecs[i].iov_base = datagram.data;
+            m_batch->iovecs[i].iov_len = datagram.size;
+
+            auto &msg_hdr = m_batch->messages[i].msg_hdr;
+            memset(&msg_hdr, 0, sizeof(msghdr));
+            msg_hdr.msg_name = const_cast<sockaddr_storage *>(&datagram.address);
+            msg_hdr.msg_namelen = datagram.address_length;
+            msg_hdr.msg_iov = &m_batch->iovecs[i];
+            msg_hdr.msg_iovlen = 1;
+        }
+
+        const auto result = sendmmsg(fd, m_batch->messages.data(), static_cast<c_uint32>(batch_size), 0);
+
+        if (result <= 0)
+            break;
+
+        sent += static_cast<size_t>(result);
+
+        if (static_cast<size_t>(result) < batch_size)
+            break;
+    }
+#else
+    for (; sent < count; ++sent) {
+        const auto &datagram = datagrams[sent];
+
+        if (sendto(fd, datagram.data, static_cast<c_int32>(datagram.size), 0, reinterpret_cast<const sockaddr *>(&datagram.address), static_cast<socklen_t>(datagram.address_length)) < 0)
+            break;
+    }
+#endif
+
+    return sent;
+}
+
+const c_fdptr CUdpSocket::socketDescriptor() const
+{
+    auto *ev = udpinfo_get_event(m_udpinfo);
+
+    if (!ev)
+        return 0;
+
+    return event_get_fd(ev);
+}
+
+const c_int32 CUdpSocket::error() const
+{
+    const auto fd = socketDescriptor();
+
+    if (fd == 0)
+        return 0;
+
+    return evutil_socket_geterror(fd);
+}
+
+const c_uint16 CUdpSocket::port() const
+{
+    return CEventDispatcher::localPort(socketDescriptor());
+}
+
+const bool CUdpSocket::setEventDispatcher(CEventDispatcher *eventDispatcher)
+{
+    if (isBound() || !eventDispatcher)
+        return false;
+
+    udpinfo_set_event_dispatcher(m_udpinfo, eventDispatcher);
+
+    return true;
+}
+
+const bool CUdpSocket::isBound() const
+{
+    return udpinfo_get_event(m_udpinfo) != nullptr;
+}
+
+const bool CUdpSocket::bind(const std::string &address, const c_uint16 port)
+{
+    if (isBound())
+        return false;
+
+    eventDispatcher()->bindDatagram(m_udpinfo, address, port);
+
+    return isBound();
+}
+
+const bool CUdpSocket::close()
+{
+    if (!isBound())
+        return false;
+
+    eventDispatcher()->closeDatagram(m_udpinfo);
+
+    return isBound();
+}
+
+const bool CUdpSocket::writeDatagram(const char *data, const size_t len, const std::string &address, const c_uint16 port)
+{
+    CDatagram datagram;
+    datagram.data = const_cast<char *>(data);
+    datagram.size = len;
+
+    if (!setDatagramAddress(datagram, address, port))
+        return false;
+
+    return writeDatagrams(&datagram, 1) == 1;
+}
+
+std::string CUdpSocket::datagramAddress(const CDatagram &datagram)
+{
+    switch (datagram.address.ss_family) {
+    case AF_INET: {
+        char addr[INET_ADDRSTRLEN];
+        evutil_inet_ntop(AF_INET, &reinterpret_cast<const sockaddr_in *>(&datagram.address)->sin_addr, addr, INET_ADDRSTRLEN);
+
+        return addr;
+    }
+
+    case AF_INET6: {
+        char addr[INET6_ADDRSTRLEN];
+        evutil_inet_ntop(AF_INET6, &reinterpret_cast<const sockaddr_in6 *>(&datagram.address)->sin6_addr, addr, INET6_ADDRSTRLEN);
+
+        return addr;
+    }
+
+    default:
+        break;
+    }
+
+    return std::string();
+}
+
+const c_uint16 CUdpSocket::datagramPort(const CDatagram &datagram)
+{
+    switch (datagram.address.ss_family) {
+    case AF_INET:
+        return ntohs(reinterpret_cast<const sockaddr_in *>(&datagram.address)->sin_port);
+
+    case AF_INET6:
+        return ntohs(reinterpret_cast<const sockaddr_in6 *>(&datagram.address)->sin6_port);
+
+    default:
+        break;
+    }
+
+    return 0;
+}
+
+const bool CUdpSocket::setDatagramAddress(CDatagram &datagram, const std::string &address, const c_uint16 port)
+{
+    // numeric only, a name lookup here would block the loop
+    evutil_addrinfo hints;
+    memset(&hints, 0, sizeof(evutil_addrinfo));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_DGRAM;
+    hints.ai_protocol = IPPROTO_UDP;
+    hints.ai_flags = EVUTIL_AI_NUMERICHOST | EVUTIL_AI_NUMERICSERV;
+
+    evutil_addrinfo *addr_info = nullptr;
+
+    if (evutil_getaddrinfo(address.c_str(), std::to_string(port).c_str(), &hints, &addr_info) != 0)
+        return false;
+
+    memset(&datagram.address, 0, sizeof(sockaddr_storage));
+    memcpy(&datagram.address, addr_info->ai_addr, addr_info->ai_addrlen);
+    datagram.address_length = static_cast<c_uint32>(addr_info->ai_addrlen);
+    datagram.truncated = false;
+
+    evutil_freeaddrinfo(addr_info);
+
+    return true;
+}
@@ -0,0 +1,93 @@
+/****************************************************************************
+**
+** Copyright (c) 2013 Calibri-Software <calibrisoftware@gmail.com>
+**
+** Permission is hereby granted, free of charge, to any person obtaining a copy
+** of this software and associated documentation files (the "Software"), to deal
+** in the Software without restriction, including without limitation the rights
+** to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+** copies of the Software, and to permit persons to whom the Software is
+** furnished to do so, subject to the following conditions:
+**
+** The above copyright notice and this permission notice shall be included in
+** all copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+** IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+** FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+** AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+** LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+** OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+** THE SOFTWARE.
+**
+****************************************************************************/
+
+#ifndef CUDPSOCKET_H
+#define CUDPSOCKET_H
+
+//! Std Includes
+#include <string>
+
+//! CEventDispatcher Includes
+#include "ceventdispatcher.h"
+
+//! Defines
+#define CUDPSOCKET_BATCH_SIZE       32
+#define CUDPSOCKET_DATAGRAM_SIZE    2048
+
+struct CDatagram
+{
+    char *data;
+    size_t size;
+    sockaddr_storage address;
+    c_uint32 address_length;
+    bool truncated;
+};
+
+class CUdpSocket
+{
+public:
+    CUdpSocket(CEventDispatcher *eventDispatcher = CEventDispatcher::instance(), const size_t batchSize = CUDPSOCKET_BATCH_SIZE, const size_t datagramSize = CUDPSOCKET_DATAGRAM_SIZE);
+    virtual ~CUdpSocket();
+
+    void setReadHandler(const CDelegate<void (udpinfo *)> &handler);
+    void setReadHandler(CDelegate<void (udpinfo *)> &&handler);
+
+    CEventDispatcher *eventDispatcher() const;
+
+    std::string address() const;
+    std::string errorString() const;
+
+    const size_t readDatagrams(CDatagram *datagrams, const size_t count);
+    const size_t writeDatagrams(const CDatagram *datagrams, const size_t count);
+
+    const c_fdptr socketDescriptor() const;
+
+    const c_int32 error() const;
+
+    const c_uint16 port() const;
+
+    const bool setEventDispatcher(CEventDispatcher *eventDispatcher);
+    const bool isBound() const;
+    const bool bind(const std::string &address, const c_uint16 port);
+    const bool close();
+    const bool writeDatagram(const char *data, const size_t len, const std::string &address, const c_uint16 port);
+
+    static std::string datagramAddress(const CDatagram &datagram);
+
+    static const c_uint16 datagramPort(const CDatagram &datagram);
+
+    static const bool setDatagramAddress(CDatagram &datagram, const std::string &address, const c_uint16 port);
+
+protected:
+    udpinfo *m_udpinfo;
+
+private:
+    C_DISABLE_COPY(CUdpSocket)
+
+    struct Batch;
+
+    Batch *m_batch;
+};
+
+#endif // CUDPSOCKET_H
@@ -28,37 +28,75 @@
 //! LibEvent Includes
 #include <event2/listener.h>
 
-CTcpServer::CTcpServer()
+//! CSocket Includes
+#include "ctcpsocket.h"
+
+CTcpServer::CTcpServer(CEventDispatcher *eventDispatcher)
     : m_serverinfo(serverinfo_new())
+    , m_rate_limit({0, 0, 0, 0, CRATELIMIT_TICK})
+    , m_connection_rate_limit({0, 0, 0, 0, CRATELIMIT_TICK})
+    , m_handoff_policy(RoundRobin)
+    , m_next_worker(0)
 {
     serverinfo_set_context(m_serverinfo, this);
+    serverinfo_set_event_dispatcher(m_serverinfo, eventDispatcher);
 }
 
 CTcpServer::~CTcpServer()
 {
     close();
+    closeWorkers();
+
+    for (auto *rate_limit_group : m_rate_limit_groups)
+        delete rate_limit_group;
 
     serverinfo_free(m_serverinfo);
 }
 
-void CTcpServer::setAcceptHandler(const std::function<void (serverinfo *, const c_fdptr)> &handler)
+void CTcpServer::setAcceptHandler(const CDelegate<void (serverinfo *, const c_fdptr)> &handler)
 {
+    if (!m_workers.empty()) {
+        for (auto *worker : m_workers)
+            serverinfo_set_accept_handler(worker, handler);
+
+        return;
+    }
+
     serverinfo_set_accept_handler(m_serverinfo, handler);
+
+    for (auto *shard : m_shards)
+        serverinfo_set_accept_handler(shard, handler);
 }
 
-void CTcpServer::setAcceptHandler(std::function<void (serverinfo *, const c_fdptr)> &&handler)
+void CTcpServer::setAcceptHandler(CDelegate<void (serverinfo *, const c_fdptr)> &&handler)
 {
+    if (!m_workers.empty()) {
+        for (auto *worker : m_workers)
+            serverinfo_set_accept_handler(worker, handler);
+
+        return;
+    }
+
     serverinfo_set_accept_handler(m_serverinfo, std::move(handler));
+
+    for (auto *shard : m_shards)
+        serverinfo_set_accept_handler(shard, serverinfo_get_accept_handler(m_serverinfo));
 }
 
-void CTcpServer::setAcceptErrorHandler(const std::function<void (serverinfo *, const c_int32)> &handler)
+void CTcpServer::setAcceptErrorHandler(const CDelegate<void (serverinfo *, const c_int32)> &handler)
 {
     serverinfo_set_accept_error_handler(m_serverinfo, handler);
+
+    for (auto *shard : m_shards)
+        serverinfo_set_accept_error_handler(shard, handler);
 }
 
-void CTcpServer::setAcceptErrorHandler(std::function<void (serverinfo *, const c_int32)> &&handler)
+void CTcpServer::setAcceptErrorHandler(CDelegate<void (serverinfo *, const c_int32)> &&handler)
 {
     serverinfo_set_accept_error_handler(m_serverinfo, std::move(handler));
+
+    for (auto *shard : m_shards)
+        serverinfo_set_accept_error_handler(shard, serverinfo_get_accept_error_handler(m_serverinfo));
 }
 
 void CTcpServer::setEnable(const bool enable)
@@ -66,10 +104,65 @@ void CTcpServer::setEnable(const bool enable)
     if (!isListening())
         return;
 
-    if (enable)
-        evconnlistener_enable(serverinfo_get_evconnlistener(m_serverinfo));
-    else
-        evconnlistener_disable(serverinfo_get_evconnlistener(m_serverinfo));
+    serverinfo_set_enabled(m_serverinfo, enable);
+
+    // the loops enable their own listeners, skipping full or draining ones
+    if (enable) {
+        CEventDispatcher::resumeServers(m_serverinfo);
+
+        return;
+    }
+
+    evconnlistener_disable(serverinfo_get_evconnlistener(m_serverinfo));
+
+    for (auto *shard : m_shards)
+        evconnlistener_disable(serverinfo_get_evconnlistener(shard));
+}
+
+void CTcpServer::setRateLimit(const size_t readRate, const size_t readBurst, const size_t writeRate, const size_t writeBurst, const c_uint32 tick)
+{
+    m_rate_limit = {readRate, readBurst, writeRate, writeBurst, tick};
+
+    if (isListening())
+        initializeRateLimitGroups();
+}
+
+void CTcpServer::setConnectionRateLimit(const size_t readRate, const size_t readBurst, const size_t writeRate, const size_t writeBurst, const c_uint32 tick)
+{
+    m_connection_rate_limit = {readRate, readBurst, writeRate, writeBurst, tick};
+}
+
+void CTcpServer::setMaxConnections(const c_uint32 count)
+{
+    serverinfo_set_max_connections(m_serverinfo, count);
+
+    if (serverinfo_resume_connections(m_serverinfo))
+        CEventDispatcher::resumeServers(m_serverinfo);
+}
+
+CEventDispatcher *CTcpServer::eventDispatcher() const
+{
+    return serverinfo_get_event_dispatcher(m_serverinfo);
+}
+
+CRateLimitGroup *CTcpServer::rateLimitGroup(CEventDispatcher *eventDispatcher) const
+{
+    for (auto *rate_limit_group : m_rate_limit_groups) {
+        if (rate_limit_group->eventDispatcher() == eventDispatcher)
+            return rate_limit_group;
+    }
+
+    return nullptr;
+}
+
+const bool CTcpServer::setEventDispatcher(CEventDispatcher *eventDispatcher)
+{
+    if (isListening() || !eventDispatcher)
+        return false;
+
+    serverinfo_set_event_dispatcher(m_serverinfo, eventDispatcher);
+
+    return true;
 }
 
 const bool CTcpServer::isListening() const
@@ -82,9 +175,117 @@ const bool CTcpServer::listen(const std::string &address, const c_uint16 port, c
     if (isListening())
         return false;
 
-    CEventDispatcher::instance()->bindServer(m_serverinfo, address, port, backlog);
+    eventDispatcher()->bindServer(m_serverinfo, address, port, backlog);
 
-    return isListening();
+    if (!isListening())
+        return false;
+
+    initializeRateLimitGroups();
+
+    return true;
+}
+
+const bool CTcpServer::listen(CEventDispatcherGroup *eventDispatcherGroup, const std::string &address, const c_uint16 port, const c_int32 backlog)
+{
+    if (isListening() || !m_workers.empty() || !eventDispatcherGroup || eventDispatcherGroup->count() == 0)
+        return false;
+
+    serverinfo_set_event_dispatcher(m_serverinfo, eventDispatcherGroup->dispatcher(0));
+
+    // listeners belong to their loops, the group may already be running
+    eventDispatcher()->invoke([this, &address, port, backlog]() {
+        eventDispatcher()->bindServer(m_serverinfo, address, port, backlog, true);
+    });
+
+    if (!isListening())
+        return false;
+
+    // every shard binds the port of the first listener, so port 0 works too
+    const auto boundPort = CEventDispatcher::localPort(socketDescriptor());
+
+    for (size_t i = 1; i < eventDispatcherGroup->count(); ++i) {
+        auto *shard = serverinfo_new();
+        serverinfo_set_context(shard, this);
+        serverinfo_set_event_dispatcher(shard, eventDispatcherGroup->dispatcher(i));
+        serverinfo_set_admission(shard, m_serverinfo);
+        serverinfo_set_accept_handler(shard, serverinfo_get_accept_handler(m_serverinfo));
+        serverinfo_set_accept_error_handler(shard, serverinfo_get_accept_error_handler(m_serverinfo));
+
+        m_shards.push_back(shard);
+
+        auto *shard_dispatcher = serverinfo_get_event_dispatcher(shard);
+
+        shard_dispatcher->invoke([shard_dispatcher, shard, &address, boundPort, backlog]() {
+            shard_dispatcher->bindServer(shard, address, boundPort, backlog, true);
+        });
+
+        if (!serverinfo_get_evconnlistener(shard)) {
+            close();
+
+            return false;
+        }
+    }
+
+    initializeRateLimitGroups();
+
+    return true;
+}
+
+const bool CTcpServer::listenLocal(const std::string &path, const c_int32 backlog)
+{
+    if (isListening())
+        return false;
+
+    eventDispatcher()->bindLocalServer(m_serverinfo, path, backlog);
+
+    if (!isListening())
+        return false;
+
+    initializeRateLimitGroups();
+
+    return true;
+}
+
+const bool CTcpServer::setWorkers(CEventDispatcherGroup *eventDispatcherGroup, const HandoffPolicy handoffPolicy)
+{
+    if (isListening())
+        return false;
+
+    closeWorkers();
+
+    if (!eventDispatcherGroup || eventDispatcherGroup->count() == 0)
+        return true;
+
+    m_handoff_policy = handoffPolicy;
+    m_next_worker = 0;
+
+    // the workers take over the user handlers, the listener keeps only the
+    // handoff and runs the admission for all of them
+    for (size_t i = 0; i < eventDispatcherGroup->count(); ++i) {
+        auto *worker = serverinfo_new();
+        serverinfo_set_context(worker, this);
+        serverinfo_set_admission(worker, m_serverinfo);
+        serverinfo_set_accept_handler(worker, serverinfo_get_accept_handler(m_serverinfo));
+
+        eventDispatcherGroup->dispatcher(i)->bindWorker(worker);
+
+        if (!serverinfo_get_handoff_event(worker)) {
+            serverinfo_free(worker);
+            closeWorkers();
+
+            return false;
+        }
+
+        m_workers.push_back(worker);
+    }
+
+    serverinfo_set_accept_handler(m_serverinfo, [this](serverinfo *server_info, const c_fdptr fd) {
+        C_UNUSED(server_info);
+
+        handoff(fd);
+    });
+
+    return true;
 }
 
 const bool CTcpServer::close()
@@ -92,14 +293,49 @@ const bool CTcpServer::close()
     if (!isListening())
         return false;
 
-    CEventDispatcher::instance()->closeServer(m_serverinfo);
+    // a shard loop may be inside its accept callback, so the listener is
+    // closed and the shard freed on that loop
+    for (auto *shard : m_shards) {
+        auto *shard_dispatcher = serverinfo_get_event_dispatcher(shard);
+
+        shard_dispatcher->invoke([shard_dispatcher, shard]() {
+            if (serverinfo_get_evconnlistener(shard))
+                shard_dispatcher->closeServer(shard);
+
+            serverinfo_free(shard);
+        });
+    }
+
+    m_shards.clear();
+
+    eventDispatcher()->invoke([this]() {
+        eventDispatcher()->closeServer(m_serverinfo);
+    });
+
+    serverinfo_set_enabled(m_serverinfo, true);
 
     return isListening();
 }
 
+const bool CTcpServer::applyRateLimit(CTcpSocket *socket) const
+{
+    if (m_connection_rate_limit.read_rate != 0 || m_connection_rate_limit.write_rate != 0) {
+        if (socket->setRateLimit(m_connection_rate_limit.read_rate, m_connection_rate_limit.read_burst,
+                                 m_connection_rate_limit.write_rate, m_connection_rate_limit.write_burst, m_connection_rate_limit.tick) != 0)
+            return false;
+    }
+
+    auto *rate_limit_group = rateLimitGroup(socket->eventDispatcher());
+
+    if (rate_limit_group)
+        socket->setRateLimitGroup(rate_limit_group);
+
+    return true;
+}
+
 std::string CTcpServer::address() const
 {
-    return CEventDispatcher::instance()->socketAddress(socketDescriptor());
+    return CEventDispatcher::localAddress(socketDescriptor());
 }
 
 std::string CTcpServer::errorString() const
@@ -127,5 +363,121 @@ const c_int32 CTcpServer::error() const
 
 const c_uint16 CTcpServer::port() const
 {
-    return CEventDispatcher::instance()->socketPort(socketDescriptor());
+    return CEventDispatcher::localPort(socketDescriptor());
+}
+
+const c_uint32 CTcpServer::maxConnections() const
+{
+    return serverinfo_get_max_connections(m_serverinfo);
+}
+
+const c_uint32 CTcpServer::connections() const
+{
+    return serverinfo_get_connections(m_serverinfo);
+}
+
+const c_uint64 CTcpServer::rejectedConnections() const
+{
+    return serverinfo_get_rejected(m_serverinfo);
+}
+
+const c_uint64 CTcpServer::readThrottled() const
+{
+    c_uint64 count = 0;
+
+    for (auto *rate_limit_group : m_rate_limit_groups)
+        count += rate_limit_group->readThrottled();
+
+    return count;
+}
+
+const c_uint64 CTcpServer::writeThrottled() const
+{
+    c_uint64 count = 0;
+
+    for (auto *rate_limit_group : m_rate_limit_groups)
+        count += rate_limit_group->writeThrottled();
+
+    return count;
+}
+
+void CTcpServer::initializeRateLimitGroups()
+{
+    if (m_rate_limit.read_rate == 0 && m_rate_limit.write_rate == 0 && m_rate_limit_groups.empty())
+        return;
+
+    // one group per listening loop, a bufferevent can only join a group
+    // bound to its own event base
+    std::vector<CEventDispatcher *> eventDispatchers(1, eventDispatcher());
+
+    for (auto *shard : m_shards)
+        eventDispatchers.push_back(serverinfo_get_event_dispatcher(shard));
+
+    for (auto *worker : m_workers)
+        eventDispatchers.push_back(serverinfo_get_event_dispatcher(worker));
+
+    for (auto *event_dispatcher : eventDispatchers) {
+        auto *rate_limit_group = rateLimitGroup(event_dispatcher);
+
+        if (rate_limit_group) {
+            rate_limit_group->setRateLimit(m_rate_limit.read_rate, m_rate_limit.read_burst, m_rate_limit.write_rate, m_rate_limit.write_burst, m_rate_limit.tick);
+
+            continue;
+        }
+
+        rate_limit_group = new CRateLimitGroup(event_dispatcher, m_rate_limit.read_rate, m_rate_limit.read_burst, m_rate_limit.write_rate, m_rate_limit.write_burst, m_rate_limit.tick);
+
+        if (!rate_limit_group->isValid()) {
+            delete rate_limit_group;
+
+            continue;
+        }
+
+        m_rate_limit_groups.push_back(rate_limit_group);
+    }
+}
+
+void CTcpServer::handoff(const c_fdptr fd)
+{
+    auto *worker = m_workers[0];
+
+    switch (m_handoff_policy) {
+    case LeastConnections:
+        for (auto *candidate : m_workers) {
+            if (serverinfo_get_load(candidate) < serverinfo_get_load(worker))
+                worker = candidate;
+        }
+
+        break;
+
+    default:
+        worker = m_workers[m_next_worker++ % m_workers.size()];
+
+        break;
+    }
+
+    // the worker carries the load until the handed off socket disconnects
+    serverinfo_get_event_dispatcher(worker)->handoffSocket(worker, fd);
+}
+
+void CTcpServer::closeWorkers()
+{
+    if (m_workers.empty())
+        return;
+
+    // give the user handlers back to the listener
+    serverinfo_set_accept_handler(m_serverinfo, serverinfo_get_accept_handler(m_workers[0]));
+
+    // the worker loop may be draining its queue right now, close it there;
+    // sockets and queued handoffs keep their own reference on the info
+    for (auto *worker : m_workers) {
+        auto *worker_dispatcher = serverinfo_get_event_dispatcher(worker);
+
+        worker_dispatcher->invoke([worker_dispatcher, worker]() {
+            worker_dispatcher->closeWorker(worker);
+            serverinfo_free(worker);
+        });
+    }
+
+    m_workers.clear();
 }
@@ -25,24 +25,48 @@
 #ifndef CTCPSERVER_H
 #define CTCPSERVER_H
 
+//! Std Includes
+#include <vector>
+
 //! CEventDispatcher Includes
 #include "ceventdispatcher.h"
+#include "ceventdispatcher_group.h"
+#include "ceventdispatcher_ratelimit.h"
+
+//! Forward Declaration
+class CTcpSocket;
 
 class CTcpServer
 {
 public:
-    CTcpServer();
+    enum HandoffPolicy : c_uint8 {
+        RoundRobin = 1,
+        LeastConnections
+    };
+
+    CTcpServer(CEventDispatcher *eventDispatcher = CEventDispatcher::instance());
     virtual ~CTcpServer();
 
-    void setAcceptHandler(const std::function<void (serverinfo *, const c_fdptr)> &handler);
-    void setAcceptHandler(std::function<void (serverinfo *, const c_fdptr)> &&handler);
-    void setAcceptErrorHandler(const std::function<void (serverinfo *, const c_int32)> &handler);
-    void setAcceptErrorHandler(std::function<void (serverinfo *, const c_int32)> &&handler);
+    void setAcceptHandler(const CDelegate<void (serverinfo *, const c_fdptr)> &handler);
+    void setAcceptHandler(CDelegate<void (serverinfo *, const c_fdptr)> &&handler);
+    void setAcceptErrorHandler(const CDelegate<void (serverinfo *, const c_int32)> &handler);
+    void setAcceptErrorHandler(CDelegate<void (serverinfo *, const c_int32)> &&handler);
     void setEnable(const bool enable = true);
+    void setRateLimit(const size_t readRate, const size_t readBurst, const size_t writeRate, const size_t writeBurst, const c_uint32 tick = CRATELIMIT_TICK);
+    void setConnectionRateLimit(const size_t readRate, const size_t readBurst, const size_t writeRate, const size_t writeBurst, const c_uint32 tick = CRATELIMIT_TICK);
+    void setMaxConnections(const c_uint32 count);
 
+    CEventDispatcher *eventDispatcher() const;
+    CRateLimitGroup *rateLimitGroup(CEventDispatcher *eventDispatcher) const;
+
+    const bool setEventDispatcher(CEventDispatcher *eventDispatcher);
     const bool isListening() const;
     const bool listen(const std::string &address, const c_uint16 port, const c_int32 backlog = -1);
+    const bool listen(CEventDispatcherGroup *eventDispatcherGroup, const std::string &address, const c_uint16 port, const c_int32 backlog = -1);
+    const bool listenLocal(const std::string &path, const c_int32 backlog = -1);
+    const bool setWorkers(CEventDispatcherGroup *eventDispatcherGroup, const HandoffPolicy handoffPolicy = RoundRobin);
     const bool close();
+    const bool applyRateLimit(CTcpSocket *socket) const;
 
     std::string address() const;
     std::string errorString() const;
@@ -53,10 +77,41 @@ public:
 
     const c_uint16 port() const;
 
+    const c_uint32 maxConnections() const;
+    const c_uint32 connections() const;
+
+    const c_uint64 rejectedConnections() const;
+    const c_uint64 readThrottled() const;
+    const c_uint64 writeThrottled() const;
+
 private:    
     C_DISABLE_COPY(CTcpServer)
 
+    struct RateLimit
+    {
+        size_t read_rate;
+        size_t read_burst;
+        size_t write_rate;
+        size_t write_burst;
+        c_uint32 tick;
+    };
+
+    void initializeRateLimitGroups();
+    void handoff(const c_fdptr fd);
+    void closeWorkers();
+
     serverinfo *m_serverinfo;
+
+    std::vector<serverinfo *> m_shards;
+    std::vector<serverinfo *> m_workers;
+    std::vector<CRateLimitGroup *> m_rate_limit_groups;
+
+    RateLimit m_rate_limit;
+    RateLimit m_connection_rate_limit;
+
+    HandoffPolicy m_handoff_policy;
+
+    size_t m_next_worker;
 };
 
 #endif // CTCPSERVER_H
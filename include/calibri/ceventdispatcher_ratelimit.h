@@ -0,0 +1,77 @@
+/****************************************************************************
+**
+** Copyright (c) 2013 Calibri-Software <calibrisoftware@gmail.com>
+**
+** Permission is hereby granted, free of charge, to any person obtaining a copy
+** of this software and associated documentation files (the "Software"), to deal
+** in the Software without restriction, including without limitation the rights
+** to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+** copies of the Software, and to permit persons to whom the Software is
+** furnished to do so, subject to the following conditions:
+**
+** The above copyright notice and this permission notice shall be included in
+** all copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+** IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+** FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+** AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+** LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+** OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+** THE SOFTWARE.
+**
+****************************************************************************/
+
+#ifndef CEVENTDISPATCHER_RATELIMIT_H
+#define CEVENTDISPATCHER_RATELIMIT_H
+
+//! Std Includes
+#include <atomic>
+
+//! LibEvent Includes
+#include <event2/bufferevent.h>
+
+//! CEventDispatcher Includes
+#include "ceventdispatcher.h"
+
+//! Defines
+#define CRATELIMIT_TICK     1000
+
+//! Shares token buckets between the sockets of one event dispatcher. The
+//! destructor detaches the open member sockets on the group's loop, closed
+//! sockets must leave the group before they reconnect.
+class CRateLimitGroup
+{
+public:
+    CRateLimitGroup(CEventDispatcher *eventDispatcher, const size_t readRate, const size_t readBurst, const size_t writeRate, const size_t writeBurst, const c_uint32 tick = CRATELIMIT_TICK);
+    virtual ~CRateLimitGroup();
+
+    void resetTotals();
+
+    CEventDispatcher *eventDispatcher() const;
+
+    const c_int32 setRateLimit(const size_t readRate, const size_t readBurst, const size_t writeRate, const size_t writeBurst, const c_uint32 tick = CRATELIMIT_TICK);
+    const c_int32 setMinShare(const size_t share);
+
+    const c_uint64 totalRead() const;
+    const c_uint64 totalWritten() const;
+    const c_uint64 readThrottled() const;
+    const c_uint64 writeThrottled() const;
+
+    const bool isValid() const;
+
+    static ev_token_bucket_cfg *createBucket(const size_t readRate, const size_t readBurst, const size_t writeRate, const size_t writeBurst, const c_uint32 tick = CRATELIMIT_TICK);
+
+private:
+    C_DISABLE_COPY(CRateLimitGroup)
+
+    CEventDispatcher *m_event_dispatcher;
+    bufferevent_rate_limit_group *m_rate_limit_group;
+
+    std::atomic<c_uint64> m_read_throttled;
+    std::atomic<c_uint64> m_write_throttled;
+
+    friend class CEventDispatcher;
+};
+
+#endif // CEVENTDISPATCHER_RATELIMIT_H
@@ -26,33 +26,67 @@
 #define CEVENTDISPATCHER_TYPES_H
 
 //! Std Includes
-#include <functional>
+#include <vector>
+
+//! Project Includes
+#include "cdelegate.h"
 
 //! CSsl Includes
 #include "cssl.h"
 
 //! Forward Declaration
+class CEventDispatcher;
+class CRateLimitGroup;
 struct timerinfo;
+struct timerwheel;
 struct event;
 struct sslinfo;
 struct socketinfo;
 struct bufferevent;
+struct ev_token_bucket_cfg;
 struct serverinfo;
 struct evconnlistener;
+struct udpinfo;
 
 /*! timerinfo */
+enum CTimerType : c_uint8 {
+    PreciseTimer = 1,
+    CoarseTimer
+};
+
 timerinfo *timerinfo_new();
 void timerinfo_free(timerinfo *timer_info);
 
+void timerinfo_set_timer_type(timerinfo *timer_info, const CTimerType timer_type);
+const CTimerType timerinfo_get_timer_type(const timerinfo *timer_info);
+
+void timerinfo_set_interval(timerinfo *timer_info, const c_uint32 interval);
+const c_uint32 timerinfo_get_interval(const timerinfo *timer_info);
+
+void timerinfo_set_repeat(timerinfo *timer_info, const bool repeat);
+const bool timerinfo_get_repeat(const timerinfo *timer_info);
+
+const bool timerinfo_is_active(const timerinfo *timer_info);
+
 void timerinfo_set_event(timerinfo *timer_info, event *ev);
 event *timerinfo_get_event(const timerinfo *timer_info);
 
 void timerinfo_set_context(timerinfo *timer_info, void *ctx);
 void *timerinfo_get_context(const timerinfo *timer_info);
 
-void timerinfo_set_timer_handler(timerinfo *timer_info, const std::function<void (timerinfo *)> &handler);
-void timerinfo_set_timer_handler(timerinfo *timer_info, std::function<void (timerinfo *)> &&handler);
-const std::function<void (timerinfo *)> &timerinfo_get_timer_handler(const timerinfo *timer_info);
+void timerinfo_set_timer_handler(timerinfo *timer_info, const CDelegate<void (timerinfo *)> &handler);
+void timerinfo_set_timer_handler(timerinfo *timer_info, CDelegate<void (timerinfo *)> &&handler);
+const CDelegate<void (timerinfo *)> &timerinfo_get_timer_handler(const timerinfo *timer_info);
+
+/*! timerwheel */
+timerwheel *timerwheel_new();
+void timerwheel_free(timerwheel *timer_wheel);
+
+void timerwheel_add(timerwheel *timer_wheel, timerinfo *timer_info, const c_uint64 ticks, const bool repeat);
+void timerwheel_remove(timerwheel *timer_wheel, timerinfo *timer_info);
+void timerwheel_advance(timerwheel *timer_wheel, const c_uint64 ticks);
+
+const size_t timerwheel_count(const timerwheel *timer_wheel);
 
 /*! sslinfo */
 sslinfo *sslinfo_new();
@@ -70,13 +104,13 @@ const CSSLPeerVerifyMode sslinfo_get_ssl_peer_verify_mode(const sslinfo *ssl_inf
 void sslinfo_set_ssl_context(sslinfo *ssl_info, SSL_CTX *ssl_ctx);
 SSL_CTX *sslinfo_get_ssl_context(const sslinfo *ssl_info);
 
-void sslinfo_set_encrypted_handler(sslinfo *ssl_info, const std::function<void (socketinfo *)> &handler);
-void sslinfo_set_encrypted_handler(sslinfo *ssl_info, std::function<void (socketinfo *)> &&handler);
-const std::function<void (socketinfo *)> &sslinfo_get_encrypted_handler(const sslinfo *ssl_info);
+void sslinfo_set_encrypted_handler(sslinfo *ssl_info, const CDelegate<void (socketinfo *)> &handler);
+void sslinfo_set_encrypted_handler(sslinfo *ssl_info, CDelegate<void (socketinfo *)> &&handler);
+const CDelegate<void (socketinfo *)> &sslinfo_get_encrypted_handler(const sslinfo *ssl_info);
 
-void sslinfo_set_ssl_error_handler(sslinfo *ssl_info, const std::function<void (socketinfo *, const c_ulong)> &handler);
-void sslinfo_set_ssl_error_handler(sslinfo *ssl_info, std::function<void (socketinfo *, const c_ulong)> &&handler);
-const std::function<void (socketinfo *, const c_ulong)> &sslinfo_get_ssl_error_handler(const sslinfo *ssl_info);
+void sslinfo_set_ssl_error_handler(sslinfo *ssl_info, const CDelegate<void (socketinfo *, const c_ulong)> &handler);
+void sslinfo_set_ssl_error_handler(sslinfo *ssl_info, CDelegate<void (socketinfo *, const c_ulong)> &&handler);
+const CDelegate<void (socketinfo *, const c_ulong)> &sslinfo_get_ssl_error_handler(const sslinfo *ssl_info);
 
 /*! socketinfo */
 enum CSocketState : c_uint8 {
@@ -86,7 +120,14 @@ enum CSocketState : c_uint8 {
     Closing
 };
 
+enum CSocketTimeout : c_uint8 {
+    ReadTimeout = 1,
+    WriteTimeout,
+    IdleTimeout
+};
+
 socketinfo *socketinfo_new();
+socketinfo *socketinfo_ref(socketinfo *socket_info);
 void socketinfo_free(socketinfo *socket_info);
 
 void socketinfo_set_socket_state(socketinfo *socket_info, const CSocketState socket_state);
@@ -98,31 +139,105 @@ bufferevent *socketinfo_get_bufferevent(const socketinfo *socket_info);
 void socketinfo_set_context(socketinfo *socket_info, void *ctx);
 void *socketinfo_get_context(const socketinfo *socket_info);
 
+void socketinfo_set_event_dispatcher(socketinfo *socket_info, CEventDispatcher *event_dispatcher);
+CEventDispatcher *socketinfo_get_event_dispatcher(const socketinfo *socket_info);
+
 void socketinfo_set_sslinfo(socketinfo *socket_info, sslinfo *ssl_info);
 sslinfo *socketinfo_get_sslinfo(const socketinfo *socket_info);
 
-void socketinfo_set_connected_handler(socketinfo *socket_info, const std::function<void (socketinfo *)> &handler);
-void socketinfo_set_connected_handler(socketinfo *socket_info, std::function<void (socketinfo *)> &&handler);
-const std::function<void (socketinfo *)> &socketinfo_get_connected_handler(const socketinfo *socket_info);
+void socketinfo_set_read_timeout(socketinfo *socket_info, const c_uint32 msec);
+const c_uint32 socketinfo_get_read_timeout(const socketinfo *socket_info);
+
+void socketinfo_set_write_timeout(socketinfo *socket_info, const c_uint32 msec);
+const c_uint32 socketinfo_get_write_timeout(const socketinfo *socket_info);
+
+void socketinfo_set_idle_timeout(socketinfo *socket_info, const c_uint32 msec);
+const c_uint32 socketinfo_get_idle_timeout(const socketinfo *socket_info);
+
+timerinfo *socketinfo_get_idle_timer(socketinfo *socket_info);
+
+void socketinfo_set_coalescing(socketinfo *socket_info, const bool coalescing);
+const bool socketinfo_get_coalescing(const socketinfo *socket_info);
+
+void socketinfo_set_flush_pending(socketinfo *socket_info, const bool flush_pending);
+const bool socketinfo_get_flush_pending(const socketinfo *socket_info);
+
+void socketinfo_set_write_full(socketinfo *socket_info, const bool write_full);
+const bool socketinfo_get_write_full(const socketinfo *socket_info);
+
+void socketinfo_set_read_low_watermark(socketinfo *socket_info, const size_t len);
+const size_t socketinfo_get_read_low_watermark(const socketinfo *socket_info);
+
+void socketinfo_set_read_high_watermark(socketinfo *socket_info, const size_t len);
+const size_t socketinfo_get_read_high_watermark(const socketinfo *socket_info);
+
+void socketinfo_set_write_low_watermark(socketinfo *socket_info, const size_t len);
+const size_t socketinfo_get_write_low_watermark(const socketinfo *socket_info);
+
+void socketinfo_set_write_high_watermark(socketinfo *socket_info, const size_t len);
+const size_t socketinfo_get_write_high_watermark(const socketinfo *socket_info);
+
+void socketinfo_set_rate_limit(socketinfo *socket_info, ev_token_bucket_cfg *rate_limit);
+ev_token_bucket_cfg *socketinfo_get_rate_limit(const socketinfo *socket_info);
+
+void socketinfo_set_rate_limit_group(socketinfo *socket_info, CRateLimitGroup *rate_limit_group);
+CRateLimitGroup *socketinfo_get_rate_limit_group(const socketinfo *socket_info);
+
+void socketinfo_set_read_throttled(socketinfo *socket_info, const c_uint64 count);
+const c_uint64 socketinfo_get_read_throttled(const socketinfo *socket_info);
 
-void socketinfo_set_disconnected_handler(socketinfo *socket_info, const std::function<void (socketinfo *)> &handler);
-void socketinfo_set_disconnected_handler(socketinfo *socket_info, std::function<void (socketinfo *)> &&handler);
-const std::function<void (socketinfo *)> &socketinfo_get_disconnected_handler(const socketinfo *socket_info);
+void socketinfo_set_write_throttled(socketinfo *socket_info, const c_uint64 count);
+const c_uint64 socketinfo_get_write_throttled(const socketinfo *socket_info);
 
-void socketinfo_set_read_handler(socketinfo *socket_info, const std::function<void (socketinfo *)> &handler);
-void socketinfo_set_read_handler(socketinfo *socket_info, std::function<void (socketinfo *)> &&handler);
-const std::function<void (socketinfo *)> &socketinfo_get_read_handler(const socketinfo *socket_info);
+void socketinfo_set_index(socketinfo *socket_info, const size_t index);
+const size_t socketinfo_get_index(const socketinfo *socket_info);
 
-void socketinfo_set_write_handler(socketinfo *socket_info, const std::function<void (socketinfo *)> &handler);
-void socketinfo_set_write_handler(socketinfo *socket_info, std::function<void (socketinfo *)> &&handler);
-const std::function<void (socketinfo *)> &socketinfo_get_write_handler(const socketinfo *socket_info);
+void socketinfo_set_serverinfo(socketinfo *socket_info, serverinfo *server_info, const bool admitted);
+serverinfo *socketinfo_get_serverinfo(const socketinfo *socket_info);
+const bool socketinfo_get_admitted(const socketinfo *socket_info);
 
-void socketinfo_set_error_handler(socketinfo *socket_info, const std::function<void (socketinfo *, const c_int32)> &handler);
-void socketinfo_set_error_handler(socketinfo *socket_info, std::function<void (socketinfo *, const c_int32)> &&handler);
-const std::function<void (socketinfo *, const c_int32)> &socketinfo_get_error_handler(const socketinfo *socket_info);
+void socketinfo_set_connected_handler(socketinfo *socket_info, const CDelegate<void (socketinfo *)> &handler);
+void socketinfo_set_connected_handler(socketinfo *socket_info, CDelegate<void (socketinfo *)> &&handler);
+const CDelegate<void (socketinfo *)> &socketinfo_get_connected_handler(const socketinfo *socket_info);
+
+void socketinfo_set_disconnected_handler(socketinfo *socket_info, const CDelegate<void (socketinfo *)> &handler);
+void socketinfo_set_disconnected_handler(socketinfo *socket_info, CDelegate<void (socketinfo *)> &&handler);
+const CDelegate<void (socketinfo *)> &socketinfo_get_disconnected_handler(const socketinfo *socket_info);
+
+void socketinfo_set_read_handler(socketinfo *socket_info, const CDelegate<void (socketinfo *)> &handler);
+void socketinfo_set_read_handler(socketinfo *socket_info, CDelegate<void (socketinfo *)> &&handler);
+const CDelegate<void (socketinfo *)> &socketinfo_get_read_handler(const socketinfo *socket_info);
+
+void socketinfo_set_write_handler(socketinfo *socket_info, const CDelegate<void (socketinfo *)> &handler);
+void socketinfo_set_write_handler(socketinfo *socket_info, CDelegate<void (socketinfo *)> &&handler);
+const CDelegate<void (socketinfo *)> &socketinfo_get_write_handler(const socketinfo *socket_info);
+
+void socketinfo_set_error_handler(socketinfo *socket_info, const CDelegate<void (socketinfo *, const c_int32)> &handler);
+void socketinfo_set_error_handler(socketinfo *socket_info, CDelegate<void (socketinfo *, const c_int32)> &&handler);
+const CDelegate<void (socketinfo *, const c_int32)> &socketinfo_get_error_handler(const socketinfo *socket_info);
+
+void socketinfo_set_timeout_handler(socketinfo *socket_info, const CDelegate<void (socketinfo *, const CSocketTimeout)> &handler);
+void socketinfo_set_timeout_handler(socketinfo *socket_info, CDelegate<void (socketinfo *, const CSocketTimeout)> &&handler);
+const CDelegate<void (socketinfo *, const CSocketTimeout)> &socketinfo_get_timeout_handler(const socketinfo *socket_info);
+
+void socketinfo_set_write_full_handler(socketinfo *socket_info, const CDelegate<void (socketinfo *)> &handler);
+void socketinfo_set_write_full_handler(socketinfo *socket_info, CDelegate<void (socketinfo *)> &&handler);
+const CDelegate<void (socketinfo *)> &socketinfo_get_write_full_handler(const socketinfo *socket_info);
+
+void socketinfo_set_write_drained_handler(socketinfo *socket_info, const CDelegate<void (socketinfo *)> &handler);
+void socketinfo_set_write_drained_handler(socketinfo *socket_info, CDelegate<void (socketinfo *)> &&handler);
+const CDelegate<void (socketinfo *)> &socketinfo_get_write_drained_handler(const socketinfo *socket_info);
 
 /*! serverinfo */
+enum CAdmission : c_uint8 {
+    Admitted = 1,
+    AdmittedLast,
+    Rejected,
+    Unlimited
+};
+
 serverinfo *serverinfo_new();
+serverinfo *serverinfo_ref(serverinfo *server_info);
 void serverinfo_free(serverinfo *server_info);
 
 void serverinfo_set_evconnlistener(serverinfo *server_info, evconnlistener *ev_conn_listener);
@@ -131,12 +246,66 @@ evconnlistener *serverinfo_get_evconnlistener(const serverinfo *server_info);
 void serverinfo_set_context(serverinfo *server_info, void *ctx);
 void *serverinfo_get_context(const serverinfo *server_info);
 
-void serverinfo_set_accept_handler(serverinfo *server_info, const std::function<void (serverinfo *, const c_fdptr)> &handler);
-void serverinfo_set_accept_handler(serverinfo *server_info, std::function<void (serverinfo *, const c_fdptr)> &&handler);
-const std::function<void (serverinfo *, const c_fdptr)> &serverinfo_get_accept_handler(const serverinfo *server_info);
+void serverinfo_set_event_dispatcher(serverinfo *server_info, CEventDispatcher *event_dispatcher);
+CEventDispatcher *serverinfo_get_event_dispatcher(const serverinfo *server_info);
+
+void serverinfo_set_accept_handler(serverinfo *server_info, const CDelegate<void (serverinfo *, const c_fdptr)> &handler);
+void serverinfo_set_accept_handler(serverinfo *server_info, CDelegate<void (serverinfo *, const c_fdptr)> &&handler);
+const CDelegate<void (serverinfo *, const c_fdptr)> &serverinfo_get_accept_handler(const serverinfo *server_info);
+
+void serverinfo_set_accept_error_handler(serverinfo *server_info, const CDelegate<void (serverinfo *, const c_int32)> &handler);
+void serverinfo_set_accept_error_handler(serverinfo *server_info, CDelegate<void (serverinfo *, const c_int32)> &&handler);
+const CDelegate<void (serverinfo *, const c_int32)> &serverinfo_get_accept_error_handler(const serverinfo *server_info);
+
+void serverinfo_set_admission(serverinfo *server_info, serverinfo *admission);
+serverinfo *serverinfo_get_admission(const serverinfo *server_info);
+
+void serverinfo_set_max_connections(serverinfo *server_info, const c_uint32 max_connections);
+const c_uint32 serverinfo_get_max_connections(const serverinfo *server_info);
+
+const c_uint32 serverinfo_get_connections(const serverinfo *server_info);
+const c_uint64 serverinfo_get_rejected(const serverinfo *server_info);
+
+void serverinfo_set_enabled(serverinfo *server_info, const bool enabled);
+const bool serverinfo_get_enabled(const serverinfo *server_info);
+const bool serverinfo_get_paused(const serverinfo *server_info);
+
+const CAdmission serverinfo_acquire_connection(serverinfo *server_info);
+const bool serverinfo_release_connection(serverinfo *server_info);
+const bool serverinfo_resume_connections(serverinfo *server_info);
+
+void serverinfo_add_listener(serverinfo *server_info);
+void serverinfo_remove_listener(serverinfo *server_info);
+std::vector<serverinfo *> serverinfo_ref_listeners(serverinfo *server_info);
+
+void serverinfo_add_load(serverinfo *server_info, const c_int32 delta);
+const c_uint32 serverinfo_get_load(const serverinfo *server_info);
+
+void serverinfo_set_handoff_event(serverinfo *server_info, event *ev);
+event *serverinfo_get_handoff_event(const serverinfo *server_info);
+
+const bool serverinfo_handoff_push(serverinfo *server_info, const c_fdptr fd, const bool admitted);
+const bool serverinfo_handoff_pop(serverinfo *server_info, c_fdptr &fd, bool &admitted);
+const bool serverinfo_set_handoff_pending(serverinfo *server_info, const bool pending);
+
+/*! udpinfo */
+udpinfo *udpinfo_new();
+void udpinfo_free(udpinfo *udp_info);
+
+void udpinfo_set_event(udpinfo *udp_info, event *ev);
+event *udpinfo_get_event(const udpinfo *udp_info);
+
+void udpinfo_set_context(udpinfo *udp_info, void *ctx);
+void *udpinfo_get_context(const udpinfo *udp_info);
+
+void udpinfo_set_event_dispatcher(udpinfo *udp_info, CEventDispatcher *event_dispatcher);
+CEventDispatcher *udpinfo_get_event_dispatcher(const udpinfo *udp_info);
+
+void udpinfo_set_read_handler(udpinfo *udp_info, const CDelegate<void (udpinfo *)> &handler);
+void udpinfo_set_read_handler(udpinfo *udp_info, CDelegate<void (udpinfo *)> &&handler);
+const CDelegate<void (udpinfo *)> &udpinfo_get_read_handler(const udpinfo *udp_info);
 
-void serverinfo_set_accept_error_handler(serverinfo *server_info, const std::function<void (serverinfo *, const c_int32)> &handler);
-void serverinfo_set_accept_error_handler(serverinfo *server_info, std::function<void (serverinfo *, const c_int32)> &&handler);
-const std::function<void (serverinfo *, const c_int32)> &serverinfo_get_accept_error_handler(const serverinfo *server_info);
+/*! infopool */
+void infopool_reserve(const size_t count);
 
 #endif // CEVENTDISPATCHER_TYPES_H
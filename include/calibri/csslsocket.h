@@ -31,13 +31,13 @@
 class CSslSocket : public CTcpSocket
 {
 public:
-    CSslSocket();
+    CSslSocket(CEventDispatcher *eventDispatcher = CEventDispatcher::instance());
     virtual ~CSslSocket();
 
-    void setEncryptedHandler(const std::function<void (socketinfo *)> &handler);
-    void setEncryptedHandler(std::function<void (socketinfo *)> &&handler);
-    void setSslErrorHandler(const std::function<void (socketinfo *, const c_ulong)> &handler);
-    void setSslErrorHandler(std::function<void (socketinfo *, const c_ulong)> &&handler);
+    void setEncryptedHandler(const CDelegate<void (socketinfo *)> &handler);
+    void setEncryptedHandler(CDelegate<void (socketinfo *)> &&handler);
+    void setSslErrorHandler(const CDelegate<void (socketinfo *, const c_ulong)> &handler);
+    void setSslErrorHandler(CDelegate<void (socketinfo *, const c_ulong)> &&handler);
     void setSslProtocol(const CSSLProtocol sslProtocol);
     void setSslMode(const CSSLMode sslMode);
     void setSslPeerVerifyMode(const CSSLPeerVerifyMode sslPeerVerifyMode);
@@ -0,0 +1,154 @@
+/****************************************************************************
+**
+** Copyright (c) 2013 Calibri-Software <calibrisoftware@gmail.com>
+**
+** Permission is hereby granted, free of charge, to any person obtaining a copy
+** of this software and associated documentation files (the "Software"), to deal
+** in the Software without restriction, including without limitation the rights
+** to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+** copies of the Software, and to permit persons to whom the Software is
+** furnished to do so, subject to the following conditions:
+**
+** The above copyright notice and this permission notice shall be included in
+** all copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+** IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+** FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+** AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+** LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+** OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+** THE SOFTWARE.
+**
+****************************************************************************/
+
+#ifndef CTCPSOCKETT_H
+#define CTCPSOCKETT_H
+
+//! LibEvent Includes
+#include <event2/bufferevent.h>
+
+//! CSocket Includes
+#include "ctcpsocket.h"
+
+//! Statically dispatched socket: Derived hides onConnected, onRead and
+//! onWrite, which the bufferevent callbacks call directly. Disconnect,
+//! error and timeout events are rare and still go through delegates.
+//! The callbacks are bound whenever the socket gets a bufferevent, also
+//! when it is connected through a CTcpSocket pointer.
+template<class Derived>
+class CTcpSocketT : public CTcpSocket
+{
+public:
+    inline CTcpSocketT(CEventDispatcher *eventDispatcher = CEventDispatcher::instance())
+        : CTcpSocket(eventDispatcher)
+    {
+    }
+
+    inline ~CTcpSocketT()
+    {
+        // Derived is already gone, do not call back into it while closing
+        setDisconnectedHandler(nullptr);
+        setErrorHandler(nullptr);
+        setTimeoutHandler(nullptr);
+
+        CTcpSocket::bindNotifications();
+    }
+
+protected:
+    inline void onConnected() {}
+    inline void onDisconnected() {}
+    inline void onRead() {}
+    inline void onWrite() {}
+    inline void onError(const c_int32 error) { C_UNUSED(error); }
+    inline void onTimeout(const CSocketTimeout timeout) { C_UNUSED(timeout); }
+
+    inline void bindNotifications()
+    {
+        auto *buffer_event = socketinfo_get_bufferevent(m_socketinfo);
+
+        if (!buffer_event)
+            return;
+
+        bufferevent_setcb(buffer_event, &CTcpSocketT::readNotification, &CTcpSocketT::writeNotification, &CTcpSocketT::eventNotification, this);
+
+        // set again each time, owners such as a connection pool clear the
+        // delegates before they hand the socket back
+        setDisconnectedHandler([this](socketinfo *socket_info) {
+            C_UNUSED(socket_info);
+
+            derived()->onDisconnected();
+        });
+
+        setErrorHandler([this](socketinfo *socket_info, const c_int32 error) {
+            C_UNUSED(socket_info);
+
+            derived()->onError(error);
+        });
+
+        setTimeoutHandler([this](socketinfo *socket_info, const CSocketTimeout timeout) {
+            C_UNUSED(socket_info);
+
+            derived()->onTimeout(timeout);
+        });
+    }
+
+private:
+    inline Derived *derived()
+    {
+        return static_cast<Derived *>(this);
+    }
+
+    inline void touch()
+    {
+        if (socketinfo_get_idle_timeout(m_socketinfo) != 0)
+            eventDispatcher()->touchTimer(socketinfo_get_idle_timer(m_socketinfo));
+    }
+
+    static inline void readNotification(bufferevent *buffer_event, void *ctx)
+    {
+        C_UNUSED(buffer_event);
+
+        auto *socket = static_cast<CTcpSocketT *>(ctx);
+
+        if (socketinfo_get_socket_state(socket->m_socketinfo) != Connected)
+            return;
+
+        socket->touch();
+        socket->derived()->onRead();
+    }
+
+    static inline void writeNotification(bufferevent *buffer_event, void *ctx)
+    {
+        auto *socket = static_cast<CTcpSocketT *>(ctx);
+
+        if (socketinfo_get_socket_state(socket->m_socketinfo) != Connected) {
+            CEventDispatcher::socketWriteNotification(buffer_event, socket->m_socketinfo);
+
+            return;
+        }
+
+        CEventDispatcher::socketWritten(socket->m_socketinfo);
+
+        socket->derived()->onWrite();
+    }
+
+    static inline void eventNotification(bufferevent *buffer_event, const c_int16 events, void *ctx)
+    {
+        auto *socket = static_cast<CTcpSocketT *>(ctx);
+
+        if ((events & BEV_EVENT_CONNECTED) && !socketinfo_get_sslinfo(socket->m_socketinfo)) {
+            CEventDispatcher::socketConnected(socket->m_socketinfo);
+
+            socket->derived()->onConnected();
+
+            return;
+        }
+
+        CEventDispatcher::socketEventNotification(buffer_event, events, socket->m_socketinfo);
+    }
+
+    C_DISABLE_COPY(CTcpSocketT)
+};
+
+#endif // CTCPSOCKETT_H
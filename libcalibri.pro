@@ -15,6 +15,7 @@ CONFIG(debug, debug|release) {
 
 HEADERS    += \
     cdatastream.h \
+    cdelegate.h \
     cdefines.h
 
 include(ctcpserver/ctcpserver.pri)
@@ -59,6 +60,8 @@ win32 {
         -levent_core \
         -levent_extra \
         -levent_openssl \
+        -levent_pthreads \
+        -lpthread \
         -lcrypto \
         -lssl
 